@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+#
+# Microbenchmarks for pyclops call overhead (run with 'make bench', which builds bench_module.so).
+#
+# Prints one line per benchmark (name, ns/call), and optionally writes the results as json.
+# Given a baseline json file (from a previous run), also prints the ratio to the baseline, and
+# exits with nonzero status if any benchmark got slower by more than the tolerance.
+#
+#   make bench                                          # just run
+#   make bench BENCH_ARGS='-o before.json'              # save results
+#   make bench BENCH_ARGS='-b before.json -t 0.1'       # compare (fail if >10% slower)
+
+import sys
+import json
+import timeit
+import argparse
+
+import numpy as np
+import bench_module as bm
+
+
+class Sub(bm.Base):
+    def g(self, n):
+        return n
+
+
+def throw_error():
+    try:
+        bm.throw_error()
+    except RuntimeError:
+        pass
+
+
+def set_x():
+    obj.x = 3
+
+
+obj = bm.Obj(0)
+held = bm.get_same_obj()     # keep python object alive, so get_same_obj() hits the hash table
+base = bm.Base()
+sub = Sub()
+a_ok = np.zeros(16, dtype=np.float64)     # accepted by in_carray<double> without a copy
+a_copy = np.zeros(16, dtype=np.int32)     # converted (copied) by in_carray<double>
+a_list = [ 0.0 ] * 16                     # converted (copied) by in_carray<double>
+
+
+# (name, callable) pairs.  The first benchmark is the empty function, for reference.
+benchmarks = [
+    ('noop', bm.noop),
+    ('wrap_func_positional', lambda: bm.add(1, 2)),
+    ('wrap_func_kwargs', lambda: bm.add(x=1, y=2)),
+    ('wrap_func_defaults', lambda: bm.add_defaults(1)),
+    ('wrap_method', obj.get),
+    ('property_get', lambda: obj.x),
+    ('property_set', set_x),
+    ('wrap_constructor', lambda: bm.Obj(1)),
+    ('to_python_hash_hit', bm.get_same_obj),
+    ('to_python_hash_miss', bm.make_obj),
+    ('virtual_not_overridden', lambda: base.g_cpp(1)),
+    ('virtual_overridden', lambda: sub.g_cpp(1)),
+    ('array_accept', lambda: bm.first_element(a_ok)),
+    ('array_copy', lambda: bm.first_element(a_copy)),
+    ('array_copy_list', lambda: bm.first_element(a_list)),
+    ('exception', throw_error),
+    ('python_empty_function', lambda: None),
+]
+
+
+def run(f, niter, nrepeat):
+    """Returns ns/call (best of 'nrepeat' timings)."""
+    t = min(timeit.repeat(f, number=niter, repeat=nrepeat))
+    return 1.0e9 * t / niter
+
+
+parser = argparse.ArgumentParser(description='pyclops call-overhead microbenchmarks')
+parser.add_argument('-n', type=int, default=100000, help='calls per timing (default 100000)')
+parser.add_argument('-r', type=int, default=5, help='timings per benchmark, best is reported (default 5)')
+parser.add_argument('-o', metavar='OUTFILE', help='write results to json file')
+parser.add_argument('-b', metavar='BASELINE', help='compare to json file from a previous run')
+parser.add_argument('-t', type=float, default=0.2, help='tolerance for regressions in baseline comparison (default 0.2)')
+parser.add_argument('-k', metavar='SUBSTRING', help='only run benchmarks whose name contains SUBSTRING')
+args = parser.parse_args()
+
+baseline = json.load(open(args.b))['ns_per_call'] if args.b else { }
+results = { }
+regressions = [ ]
+
+for (name, f) in benchmarks:
+    if args.k and (args.k not in name):
+        continue
+
+    ns = results[name] = run(f, args.n, args.r)
+
+    if name not in baseline:
+        print '%-28s %10.1f' % (name, ns)
+        continue
+
+    ratio = ns / baseline[name]
+    flag = ''
+
+    if ratio > 1.0 + args.t:
+        regressions.append(name)
+        flag = '  REGRESSION'
+
+    print '%-28s %10.1f %10.1f %8.3f%s' % (name, ns, baseline[name], ratio, flag)
+
+if args.o:
+    with open(args.o, 'w') as f:
+        json.dump({ 'niter': args.n, 'nrepeat': args.r, 'ns_per_call': results }, f, indent=4, separators=(',', ': '), sort_keys=True)
+        f.write('\n')
+
+if regressions:
+    print >>sys.stderr, 'bench-script.py: %d regression(s) relative to %s: %s' % (len(regressions), args.b, ', '.join(regressions))
+    sys.exit(1)
@@ -0,0 +1,105 @@
+// Benchmark module for bench-script.py (see 'make bench').
+// Each function exercises one pyclops call path, and does as little work as possible otherwise.
+
+// Suggest #including pyclops first, to avoid gcc warning "_POSIX_C_SOURCE redefined"
+#include "pyclops.hpp"
+
+using namespace std;
+using namespace pyclops;
+
+
+static void noop() { }
+
+static ssize_t add(ssize_t x, ssize_t y) { return x+y; }
+
+static ssize_t add_defaults(ssize_t x, ssize_t y=1, ssize_t z=2) { return x+y+z; }
+
+static double first_element(in_carray<double> a) { return a.data[0]; }
+
+static void throw_error() { throw runtime_error("bench_module: expected exception"); }
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+struct Obj {
+    ssize_t x;
+    Obj(ssize_t x_) : x(x_) { }
+    ssize_t get() const { return x; }
+};
+
+static extension_type<Obj> Obj_type("Obj", "Trivial extension type, for benchmarking");
+
+namespace pyclops {
+    template<> struct xconverter<Obj> { static constexpr extension_type<Obj> *type = &Obj_type; };
+}
+
+// Returning the same shared_ptr each time hits the master hash table (after the first call).
+// Returning a new shared_ptr each time misses, and creates a new python object.
+static shared_ptr<Obj> g_Obj = make_shared<Obj> (0);
+static shared_ptr<Obj> get_same_obj() { return g_Obj; }
+static shared_ptr<Obj> make_obj() { return make_shared<Obj> (0); }
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+struct Base {
+    virtual ~Base() { }
+    virtual ssize_t g(ssize_t n) { return n; }
+    ssize_t g_cpp(ssize_t n) { return g(n); }   // Forces call to g() to go through C++ code.
+};
+
+static extension_type<Base> Base_type("Base", "Base class with a virtual function g(), for benchmarking upcalls");
+
+namespace pyclops {
+    template<> struct xconverter<Base> { static constexpr extension_type<Base> *type = &Base_type; };
+}
+
+// "Upcalling" base class.
+struct PyBase : public Base {
+    virtual ssize_t g(ssize_t n) override
+    {
+	virtual_function<ssize_t> v(Base_type, this, "g");
+	if (v.exists)
+	    return v.upcall(n);
+	return Base::g(n);
+    }
+};
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+PyMODINIT_FUNC initbench_module(void)
+{
+    import_array();
+
+    extension_module m("bench_module", "Benchmark module for bench-script.py");
+
+    m.add_function("noop", wrap_func(noop));
+    m.add_function("add", wrap_func(add, "x", "y"));
+    m.add_function("add_defaults", wrap_func(add_defaults, "x", kwarg("y",1), kwarg("z",2)));
+    m.add_function("first_element", wrap_func(first_element, "a"));
+    m.add_function("throw_error", wrap_func(throw_error));
+    m.add_function("get_same_obj", wrap_func(get_same_obj));
+    m.add_function("make_obj", wrap_func(make_obj));
+
+    std::function<Obj* (ssize_t)> Obj_init = [](ssize_t x) { return new Obj(x); };
+    std::function<ssize_t& (Obj *)> Obj_x = [](Obj *p) -> ssize_t & { return p->x; };
+
+    Obj_type.add_constructor(wrap_constructor(Obj_init, "x"));
+    Obj_type.add_method("get", "returns x", wrap_method(&Obj::get));
+    Obj_type.add_property("x", "settable property", Obj_x);
+
+    std::function<Base* ()> Base_init = []() { return new PyBase(); };
+
+    Base_type.add_constructor(wrap_constructor(Base_init));
+    Base_type.add_method("g", "virtual function", wrap_method(&Base::g, "n"));
+    Base_type.add_method("g_cpp", "forces call to g() to go through C++", wrap_method(&Base::g_cpp, "n"));
+
+    m.add_type(Obj_type);
+    m.add_type(Base_type);
+
+    m.finalize();
+}
@@ -0,0 +1,176 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/call_stats.hpp"
+
+#include <map>
+#include <cstring>
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+bool _getenv_flag(const char *name)
+{
+    const char *s = getenv(name);
+    return s && (atoi(s) != 0);
+}
+
+bool _call_stats_enabled = _getenv_flag("PYCLOPS_CALL_STATS");
+thread_local int64_t _call_stats_marks[2] = { -1, -1 };
+
+// FIXME memory leak (intentional, since the cfunction_table entries are never freed either).
+static map<string, call_stats *> *all_call_stats = nullptr;
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// call_stats
+
+
+call_stats::call_stats(const string &name_) :
+    name(name_)
+{
+    reset();
+}
+
+
+void call_stats::reset()
+{
+    ncalls = nerrors = 0;
+    total_ns = max_ns = 0;
+    memset(phase_ns, 0, sizeof(phase_ns));
+    memset(histogram, 0, sizeof(histogram));
+}
+
+
+void call_stats::add(const int64_t *dt, bool error)
+{
+    int64_t t = 0;
+
+    for (int p = 0; p < nphases; p++) {
+	histogram[p][_log2_bucket(dt[p], nbuckets)]++;
+	phase_ns[p] += dt[p];
+	t += dt[p];
+    }
+
+    ncalls++;
+    nerrors += error ? 1 : 0;
+    total_ns += t;
+    max_ns = max(max_ns, t);
+}
+
+
+void _call_stats_timer::stop(bool error)
+{
+    int64_t t1 = _call_stats_now();
+    int64_t m0 = (_call_stats_marks[0] >= 0) ? _call_stats_marks[0] : t0;
+    int64_t m1 = (_call_stats_marks[1] >= 0) ? _call_stats_marks[1] : t1;
+
+    // Markers can be missing (e.g. if the call failed, or the function wasn't created by
+    // wrap_func()), in which case the time goes to the body.
+    m1 = max(m1, m0);
+
+    int64_t dt[call_stats::nphases] = { m0 - t0, m1 - m0, t1 - m1 };
+
+    if (stats)
+	stats->add(dt, error);
+
+    _call_stats_marks[0] = saved_marks[0];
+    _call_stats_marks[1] = saved_marks[1];
+}
+
+
+call_stats *make_call_stats(const string &name)
+{
+    if (!all_call_stats)
+	all_call_stats = new map<string, call_stats *> ();
+
+    call_stats *&ret = (*all_call_stats)[name];
+
+    if (!ret)
+	ret = new call_stats(name);
+
+    return ret;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+void enable_call_stats(bool on)
+{
+    _call_stats_enabled = on;
+}
+
+
+void reset_call_stats()
+{
+    if (all_call_stats)
+	for (auto &p: *all_call_stats)
+	    p.second->reset();
+}
+
+
+py_object _histogram_to_python(const int64_t *h, int nbuckets, const char *where)
+{
+    py_object ret = py_object::new_reference(PyList_New(nbuckets));
+
+    for (int i = 0; i < nbuckets; i++) {
+	// PyList_SetItem() steals a reference.
+	PyObject *x = PyLong_FromLongLong(h[i]);
+	if (!x)
+	    throw pyerr_occurred(where);
+	PyList_SetItem(ret.ptr, i, x);
+    }
+
+    return ret;
+}
+
+
+static void _set_item(py_dict &d, const char *key, const py_object &val)
+{
+    if (PyDict_SetItemString(d.ptr, key, val.ptr) < 0)
+	throw pyerr_occurred("pyclops::get_call_stats");
+}
+
+
+py_dict get_call_stats()
+{
+    static const char *phase_names[call_stats::nphases] = { "convert", "body", "to_python" };
+    static const char *phase_ns_names[call_stats::nphases] = { "convert_ns", "body_ns", "to_python_ns" };
+
+    py_dict ret;
+
+    if (!all_call_stats)
+	return ret;
+
+    for (const auto &p: *all_call_stats) {
+	const call_stats *s = p.second;
+
+	// Functions which were never called are omitted.
+	if (s->ncalls == 0)
+	    continue;
+
+	py_dict d;
+	_set_item(d, "ncalls", converter<ssize_t>::to_python(s->ncalls));
+	_set_item(d, "nerrors", converter<ssize_t>::to_python(s->nerrors));
+	_set_item(d, "total_ns", converter<ssize_t>::to_python(s->total_ns));
+	_set_item(d, "max_ns", converter<ssize_t>::to_python(s->max_ns));
+
+	for (int p = 0; p < call_stats::nphases; p++) {
+	    _set_item(d, phase_ns_names[p], converter<ssize_t>::to_python(s->phase_ns[p]));
+	    _set_item(d, phase_names[p], _histogram_to_python(s->histogram[p], call_stats::nbuckets, "pyclops::get_call_stats"));
+	}
+
+	_set_item(ret, s->name.c_str(), d);
+    }
+
+    return ret;
+}
+
+
+}  // namespace pyclops
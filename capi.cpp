@@ -0,0 +1,104 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/capi.hpp"
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+uint64_t capi_signature_hash(const char *signature)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (const unsigned char *p = (const unsigned char *) signature; *p; p++) {
+	h ^= *p;
+	h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+
+static string capsule_name(const string &module_name)
+{
+    return module_name + "._C_API";
+}
+
+
+void _capi_publish(PyObject *module, const string &module_name, const vector<pair<string, shared_ptr<_cpp_callable_base>>> &functions)
+{
+    // FIXME memory leak (never freed, but only allocated once per module).
+    // The capsule name must also outlive the capsule.
+    ssize_t n = functions.size();
+    capi_entry *entries = new capi_entry[n+1]();   // zeroed sentinel at the end
+
+    for (ssize_t i = 0; i < n; i++) {
+	// Each entry holds a reference to the callable.
+	shared_ptr<_cpp_callable_base> *ref = new shared_ptr<_cpp_callable_base> (functions[i].second);
+	_cpp_callable_base *f = ref->get();
+	const char *sig = f->signature().name();
+
+	entries[i].name = strdup(functions[i].first.c_str());
+	entries[i].signature = sig;
+	entries[i].signature_hash = capi_signature_hash(sig);
+	entries[i].c_func = f->c_function();
+	entries[i].cpp_func = f;
+    }
+
+    capi_table *table = new capi_table;
+    table->magic = capi_magic;
+    table->version = capi_version;
+    table->module_name = strdup(module_name.c_str());
+    table->nfunctions = n;
+    table->functions = entries;
+
+    PyObject *capsule = PyCapsule_New(table, strdup(capsule_name(module_name).c_str()), NULL);
+    if (!capsule)
+	throw pyerr_occurred("pyclops::extension_module::finalize");
+
+    // Note: PyModule_AddObject() steals the reference.
+    if (PyModule_AddObject(module, "_C_API", capsule) < 0)
+	throw pyerr_occurred("pyclops::extension_module::finalize");
+}
+
+
+const capi_entry *_capi_lookup(const string &module_name, const string &func_name, const type_info &signature, uint32_t version)
+{
+    string where = module_name + "." + func_name;
+    string name = capsule_name(module_name);
+
+    // PyCapsule_Import() imports the module if necessary, and checks the capsule name.
+    capi_table *table = reinterpret_cast<capi_table *> (PyCapsule_Import(name.c_str(), 0));
+    if (!table)
+	throw pyerr_occurred(where.c_str());
+
+    if (table->magic != capi_magic)
+	throw runtime_error(where + ": " + name + " is not a pyclops C API capsule");
+    if (table->version != version) {
+	throw runtime_error(where + ": module was built against pyclops C API version " + to_string(table->version)
+			    + ", but caller was built against version " + to_string(version));
+    }
+
+    const char *sig = signature.name();
+    uint64_t hash = capi_signature_hash(sig);
+
+    for (ssize_t i = 0; i < table->nfunctions; i++) {
+	const capi_entry &e = table->functions[i];
+
+	if (func_name != e.name)
+	    continue;
+	if ((e.signature_hash != hash) || strcmp(e.signature, sig))
+	    throw runtime_error(where + ": C++ signature mismatch (exported as '" + e.signature + "', caller expected '" + sig + "')");
+
+	return &e;
+    }
+
+    throw runtime_error(where + ": function not found in C API (note that only functions wrapped with wrap_func() are exported)");
+}
+
+
+}  // namespace pyclops
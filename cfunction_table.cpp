@@ -1,5 +1,8 @@
 #define NO_IMPORT_ARRAY
 #include "pyclops/internals.hpp"
+#include "pyclops/call_stats.hpp"
+#include "pyclops/gil_stats.hpp"
+#include "pyclops/probes.hpp"
 
 using namespace std;
 
@@ -25,14 +28,17 @@ static constexpr int max_kwargs_initprocs = 20;
 struct kwargs_cfunction {
     std::function<py_object(py_tuple,py_dict)> cpp_func;
     PyObject * (*c_func)(PyObject *, PyObject *, PyObject *);
+    shared_ptr<_cpp_callable_base> cpp_callable;   // see find_cpp_callable()
+    call_stats *stats = nullptr;                     // see pyclops/call_stats.hpp
+    gil_stats *gil = nullptr;                        // see pyclops/gil_stats.hpp
+    const char *name = "";                           // for the call_* probes (see pyclops/probes.hpp)
 };
 
 static vector<kwargs_cfunction> kwargs_cfunctions(max_kwargs_cfunctions);
 static int num_kwargs_cfunctions = 0;
 
 
-// non-inline
-PyObject *_kwargs_cfunction_body(PyObject *self, PyObject *args, PyObject *kwds, int N)
+static PyObject *_kwargs_cfunction_call(PyObject *self, PyObject *args, PyObject *kwds, int N)
 {
     try {
 	py_tuple a = py_tuple::borrowed_reference(args);
@@ -52,6 +58,33 @@ PyObject *_kwargs_cfunction_body(PyObject *self, PyObject *args, PyObject *kwds,
     }
 }
 
+// non-inline
+PyObject *_kwargs_cfunction_body(PyObject *self, PyObject *args, PyObject *kwds, int N)
+{
+    const kwargs_cfunction &k = kwargs_cfunctions[N];
+    PyObject *ret;
+
+    PYCLOPS_PROBE2(call_entry, k.name, (long) PyTuple_GET_SIZE(args));
+
+    if (_call_stats_enabled) {
+	_call_stats_timer t(k.stats);
+	_gil_call_timer g(_gil_stats_enabled.load(memory_order_relaxed) ? k.gil : nullptr);
+	ret = _kwargs_cfunction_call(self, args, kwds, N);
+	g.stop();
+	t.stop(!ret);
+    }
+    else if (_gil_stats_enabled.load(memory_order_relaxed)) {
+	_gil_call_timer g(k.gil);
+	ret = _kwargs_cfunction_call(self, args, kwds, N);
+	g.stop();
+    }
+    else
+	ret = _kwargs_cfunction_call(self, args, kwds, N);
+
+    PYCLOPS_PROBE2(call_return, k.name, (!ret) ? 1 : 0);
+    return ret;
+}
+
 template<int N>
 static PyObject *kwargs_cfunction_body(PyObject *self, PyObject *args, PyObject *kwds)
 {
@@ -70,13 +103,22 @@ inline void initialize_kwargs_cfunctions()
 }
 
 
-PyCFunction make_kwargs_cfunction(std::function<py_object(py_tuple,py_dict)> f)
+PyCFunction make_kwargs_cfunction(std::function<py_object(py_tuple,py_dict)> f, const char *name)
 {
     if (num_kwargs_cfunctions >= max_kwargs_cfunctions)
 	throw runtime_error("pyclops: cfunction_table is full!");
 
-    kwargs_cfunctions[num_kwargs_cfunctions].cpp_func = f;
-    return (PyCFunction) kwargs_cfunctions[num_kwargs_cfunctions++].c_func;
+    kwargs_cfunction &kf = kwargs_cfunctions[num_kwargs_cfunctions++];
+
+    // Unpack the _wrapped_func returned by wrap_func(), to avoid an extra std::function call per python call.
+    const _wrapped_func *w = f.target<_wrapped_func> ();
+
+    kf.cpp_func = w ? w->py_func : f;
+    kf.cpp_callable = w ? w->cpp_func : shared_ptr<_cpp_callable_base> ();
+    kf.stats = name ? make_call_stats(name) : nullptr;
+    kf.gil = name ? make_gil_stats(name) : nullptr;
+    kf.name = name ? strdup(name) : "";   // FIXME memory leak
+    return (PyCFunction) kf.c_func;
 }
 
 
@@ -91,14 +133,17 @@ PyCFunction make_kwargs_cfunction(std::function<py_object(py_tuple,py_dict)> f)
 struct kwargs_cmethod {
     std::function<py_object(py_object,py_tuple,py_dict)> cpp_func;
     PyObject * (*c_func)(PyObject *, PyObject *, PyObject *);
+    _cpp_binder bind;   // see find_cpp_callable()
+    call_stats *stats = nullptr;
+    gil_stats *gil = nullptr;
+    const char *name = "";
 };
 
 static vector<kwargs_cmethod> kwargs_cmethods(max_kwargs_cmethods);
 static int num_kwargs_cmethods = 0;
 
 
-// non-inline
-PyObject *_kwargs_cmethod_body(PyObject *self, PyObject *args, PyObject *kwds, int N)
+static PyObject *_kwargs_cmethod_call(PyObject *self, PyObject *args, PyObject *kwds, int N)
 {
     try {
 	py_object s = py_tuple::borrowed_reference(self);
@@ -119,6 +164,33 @@ PyObject *_kwargs_cmethod_body(PyObject *self, PyObject *args, PyObject *kwds, i
     }
 }
 
+// non-inline
+PyObject *_kwargs_cmethod_body(PyObject *self, PyObject *args, PyObject *kwds, int N)
+{
+    const kwargs_cmethod &k = kwargs_cmethods[N];
+    PyObject *ret;
+
+    PYCLOPS_PROBE2(call_entry, k.name, (long) PyTuple_GET_SIZE(args));
+
+    if (_call_stats_enabled) {
+	_call_stats_timer t(k.stats);
+	_gil_call_timer g(_gil_stats_enabled.load(memory_order_relaxed) ? k.gil : nullptr);
+	ret = _kwargs_cmethod_call(self, args, kwds, N);
+	g.stop();
+	t.stop(!ret);
+    }
+    else if (_gil_stats_enabled.load(memory_order_relaxed)) {
+	_gil_call_timer g(k.gil);
+	ret = _kwargs_cmethod_call(self, args, kwds, N);
+	g.stop();
+    }
+    else
+	ret = _kwargs_cmethod_call(self, args, kwds, N);
+
+    PYCLOPS_PROBE2(call_return, k.name, (!ret) ? 1 : 0);
+    return ret;
+}
+
 template<int N>
 static PyObject *kwargs_cmethod_body(PyObject *self, PyObject *args, PyObject *kwds)
 {
@@ -137,16 +209,26 @@ inline void initialize_kwargs_cmethods()
 }
 
 
-PyCFunction make_kwargs_cmethod(std::function<py_object(py_object,py_tuple,py_dict)> f)
+PyCFunction make_kwargs_cmethod(std::function<py_object(py_object,py_tuple,py_dict)> f, const _cpp_binder &bind, const char *name)
 {
     if (num_kwargs_cmethods >= max_kwargs_cmethods)
 	throw runtime_error("pyclops: cmethod_table is full!");
 
     kwargs_cmethods[num_kwargs_cmethods].cpp_func = f;
+    kwargs_cmethods[num_kwargs_cmethods].bind = bind;
+    kwargs_cmethods[num_kwargs_cmethods].stats = name ? make_call_stats(name) : nullptr;
+    kwargs_cmethods[num_kwargs_cmethods].gil = name ? make_gil_stats(name) : nullptr;
+    kwargs_cmethods[num_kwargs_cmethods].name = name ? strdup(name) : "";   // FIXME memory leak
     return (PyCFunction) kwargs_cmethods[num_kwargs_cmethods++].c_func;
 }
 
 
+PyCFunction make_kwargs_cmethod(std::function<py_object(py_object,py_tuple,py_dict)> f, const char *name)
+{
+    return make_kwargs_cmethod(f, _cpp_binder(), name);
+}
+
+
 // -------------------------------------------------------------------------------------------------
 //
 // kwargs_initproc
@@ -160,14 +242,16 @@ PyCFunction make_kwargs_cmethod(std::function<py_object(py_object,py_tuple,py_di
 struct kwargs_initproc {
     std::function<void(py_object, py_tuple, py_dict)> cpp_func;
     int (*c_func)(PyObject *, PyObject *, PyObject *);
+    call_stats *stats = nullptr;
+    gil_stats *gil = nullptr;
+    const char *name = "";
 };
 
 static vector<kwargs_initproc> kwargs_initprocs(max_kwargs_initprocs);
 static int num_kwargs_initprocs = 0;
 
 
-// non-inline
-int _kwargs_initproc_body(PyObject *self, PyObject *args, PyObject *kwds, int N)
+static int _kwargs_initproc_call(PyObject *self, PyObject *args, PyObject *kwds, int N)
 {
     try {
 	py_object s = py_object::borrowed_reference(self);
@@ -186,6 +270,34 @@ int _kwargs_initproc_body(PyObject *self, PyObject *args, PyObject *kwds, int N)
 }
 
 
+// non-inline
+int _kwargs_initproc_body(PyObject *self, PyObject *args, PyObject *kwds, int N)
+{
+    const kwargs_initproc &k = kwargs_initprocs[N];
+    int ret;
+
+    PYCLOPS_PROBE2(call_entry, k.name, (long) PyTuple_GET_SIZE(args));
+
+    if (_call_stats_enabled) {
+	_call_stats_timer t(k.stats);
+	_gil_call_timer g(_gil_stats_enabled.load(memory_order_relaxed) ? k.gil : nullptr);
+	ret = _kwargs_initproc_call(self, args, kwds, N);
+	g.stop();
+	t.stop(ret < 0);
+    }
+    else if (_gil_stats_enabled.load(memory_order_relaxed)) {
+	_gil_call_timer g(k.gil);
+	ret = _kwargs_initproc_call(self, args, kwds, N);
+	g.stop();
+    }
+    else
+	ret = _kwargs_initproc_call(self, args, kwds, N);
+
+    PYCLOPS_PROBE2(call_return, k.name, (ret < 0) ? 1 : 0);
+    return ret;
+}
+
+
 template<int N>
 static int kwargs_initproc_body(PyObject *type, PyObject *args, PyObject *kwds)
 {
@@ -204,12 +316,15 @@ inline void initialize_kwargs_initprocs()
 }
 
 
-initproc make_kwargs_initproc(std::function<void (py_object, py_tuple, py_dict)> f)
+initproc make_kwargs_initproc(std::function<void (py_object, py_tuple, py_dict)> f, const char *name)
 {
     if (num_kwargs_initprocs >= max_kwargs_initprocs)
 	throw runtime_error("pyclops: initproc_table is full!");
 
     kwargs_initprocs[num_kwargs_initprocs].cpp_func = f;
+    kwargs_initprocs[num_kwargs_initprocs].stats = name ? make_call_stats(name) : nullptr;
+    kwargs_initprocs[num_kwargs_initprocs].gil = name ? make_gil_stats(name) : nullptr;
+    kwargs_initprocs[num_kwargs_initprocs].name = name ? strdup(name) : "";   // FIXME memory leak
     return kwargs_initprocs[num_kwargs_initprocs++].c_func;
 }
 
@@ -261,6 +376,38 @@ int pyclops_setter(PyObject *self, PyObject *value, void *closure)
 }
 
 
+// -------------------------------------------------------------------------------------------------
+//
+// find_cpp_callable().
+//
+// Note: this is a linear search of the tables, which is fine since it's called once per
+// conversion to std::function (see pyclops/function_converters.hpp), not once per call.
+
+
+shared_ptr<_cpp_callable_base> find_cpp_callable(PyObject *x)
+{
+    if (!PyCFunction_Check(x))
+	return shared_ptr<_cpp_callable_base> ();
+
+    PyCFunctionObject *cf = reinterpret_cast<PyCFunctionObject *> (x);
+    PyObject * (*meth)(PyObject *, PyObject *, PyObject *) = (PyObject * (*)(PyObject *, PyObject *, PyObject *)) cf->m_ml->ml_meth;
+
+    for (int i = 0; i < num_kwargs_cfunctions; i++)
+	if (kwargs_cfunctions[i].c_func == meth)
+	    return kwargs_cfunctions[i].cpp_callable;
+
+    // Methods must be bound (i.e. obtained from an instance, not the type).
+    if (!cf->m_self)
+	return shared_ptr<_cpp_callable_base> ();
+
+    for (int i = 0; i < num_kwargs_cmethods; i++)
+	if (kwargs_cmethods[i].c_func == meth)
+	    return kwargs_cmethods[i].bind ? kwargs_cmethods[i].bind(cf->m_self) : shared_ptr<_cpp_callable_base> ();
+
+    return shared_ptr<_cpp_callable_base> ();
+}
+
+
 // -------------------------------------------------------------------------------------------------
 
 
@@ -0,0 +1,316 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/completion_queue.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// completion_queue
+//
+// On Linux, the queue is signalled through an eventfd.  Elsewhere (e.g. osx), we fall back to a
+// nonblocking pipe, and python waits on the read end.
+
+
+completion_queue::completion_queue() :
+    head(nullptr)
+{
+#ifdef __linux__
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wfd = fd;
+    if (fd < 0)
+	throw runtime_error(string("pyclops::completion_queue: eventfd() failed: ") + strerror(errno));
+#else
+    int p[2];
+    if (pipe(p) < 0)
+	throw runtime_error(string("pyclops::completion_queue: pipe() failed: ") + strerror(errno));
+
+    for (int i = 0; i < 2; i++) {
+	fcntl(p[i], F_SETFL, fcntl(p[i], F_GETFL) | O_NONBLOCK);
+	fcntl(p[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    fd = p[0];
+    wfd = p[1];
+#endif
+}
+
+
+completion_queue::~completion_queue()
+{
+    node *p = head.exchange(nullptr);
+
+    while (p) {
+	node *next = p->next;
+	delete p;
+	p = next;
+    }
+
+    if (wfd != fd)
+	close(wfd);
+    close(fd);
+}
+
+
+void completion_queue::post(const shared_ptr<future_state> &s)
+{
+    node *n = new node;
+    n->state = s;
+
+    node *h = head.load(memory_order_relaxed);
+
+    do {
+	n->next = h;
+    } while (!head.compare_exchange_weak(h, n, memory_order_release, memory_order_relaxed));
+
+    // Only signal python when the queue goes from empty to non-empty.
+    // (An eventfd write can only fail if the counter overflows, and a full pipe is already readable.)
+    if (!h) {
+#ifdef __linux__
+	uint64_t one = 1;
+	ssize_t err = write(wfd, &one, sizeof(one));
+#else
+	char one = 1;
+	ssize_t err = write(wfd, &one, 1);
+#endif
+	(void) err;
+    }
+}
+
+
+vector<shared_ptr<future_state>> completion_queue::drain()
+{
+    // Reset the fd before emptying the queue.  This ordering ensures that a post() which sees an
+    // empty queue (and writes to the fd) is never followed by a reset, so that no wakeup is lost.
+#ifdef __linux__
+    uint64_t buf;
+    ssize_t err = read(fd, &buf, sizeof(buf));
+#else
+    char buf[256];
+    ssize_t err;
+    while ((err = read(fd, buf, sizeof(buf))) > 0)
+	;
+#endif
+    (void) err;
+
+    node *p = head.exchange(nullptr, memory_order_acquire);
+
+    vector<shared_ptr<future_state>> ret;
+
+    while (p) {
+	node *next = p->next;
+	ret.push_back(std::move(p->state));
+	delete p;
+	p = next;
+    }
+
+    // The stack is in reverse posting order.
+    std::reverse(ret.begin(), ret.end());
+    return ret;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// The python completion_queue object.
+
+
+struct completion_queue_object {
+    PyObject_HEAD
+
+    // Allocated with new(), and deleted when the object is deallocated.
+    shared_ptr<completion_queue> *q;
+};
+
+
+static PyTypeObject *cq_type();
+
+
+static void cq_dealloc(PyObject *self)
+{
+    completion_queue_object *cp = reinterpret_cast<completion_queue_object *> (self);
+
+    delete cp->q;
+    cp->q = NULL;
+    PyObject_Del(self);
+}
+
+
+static PyObject *cq_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    if ((PyTuple_Size(args) > 0) || (kwds && (PyDict_Size(kwds) > 0))) {
+	PyErr_SetString(PyExc_TypeError, "pyclops.completion_queue() takes no arguments");
+	return NULL;
+    }
+
+    try {
+	py_object ret = completion_queue_to_python(make_shared<completion_queue> ());
+
+	PyObject *p = ret.ptr;
+	ret.ptr = NULL;  // steal reference
+	return p;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+static PyObject *cq_fileno(PyObject *self, PyObject *args)
+{
+    completion_queue_object *cp = reinterpret_cast<completion_queue_object *> (self);
+    return PyInt_FromLong((*cp->q)->fileno());
+}
+
+
+static PyObject *cq_watch(PyObject *self, PyObject *args)
+{
+    PyObject *f = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &f))
+	return NULL;
+
+    try {
+	completion_queue_object *cp = reinterpret_cast<completion_queue_object *> (self);
+	py_object fobj = py_object::borrowed_reference(f);
+	shared_ptr<future_state> s = future_state_from_python(fobj, "pyclops.completion_queue.watch()");
+
+	s->add_queue(*cp->q, fobj);
+	Py_RETURN_NONE;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+static PyObject *cq_drain(PyObject *self, PyObject *args)
+{
+    try {
+	completion_queue_object *cp = reinterpret_cast<completion_queue_object *> (self);
+	vector<shared_ptr<future_state>> v = (*cp->q)->drain();
+
+	py_object ret = py_object::new_reference(PyList_New(0));
+
+	for (const shared_ptr<future_state> &s: v) {
+	    py_object f = s->queued_self;
+
+	    if (--s->queued_count <= 0) {
+		s->queued_count = 0;
+		s->queued_self = py_object();
+	    }
+
+	    // Convert all results in one pass.  If the C++ call (or the conversion) failed, the
+	    // exception is saved in the future, and raised again by each call to result().  If the
+	    // conversion raised a python exception, get_result() has saved the exception itself
+	    // (see future_state::get_result()), so the error indicator can be cleared here.
+	    try {
+		s->get_result();
+	    } catch (pyerr_occurred &) {
+		PyErr_Clear();
+	    } catch (...) {
+	    }
+
+	    if (PyList_Append(ret.ptr, f.ptr) < 0)
+		throw pyerr_occurred("pyclops.completion_queue.drain()");
+	}
+
+	PyObject *p = ret.ptr;
+	ret.ptr = NULL;  // steal reference
+	return p;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+static PyMethodDef cq_methods[] = {
+    { "fileno", (PyCFunction) cq_fileno, METH_NOARGS, "Returns the file descriptor, which becomes readable when futures have completed" },
+    { "watch", (PyCFunction) cq_watch, METH_VARARGS, "watch(future): posts the future to this queue when it completes" },
+    { "drain", (PyCFunction) cq_drain, METH_NOARGS, "Returns a list of all completed futures (with results converted), and resets the file descriptor" },
+    { NULL, NULL, 0, NULL }
+};
+
+
+static PyTypeObject *cq_type()
+{
+    static PyTypeObject *ret = nullptr;
+
+    if (ret)
+	return ret;
+
+    PyTypeObject *tobj = _make_static_type("pyclops.completion_queue", "Queue of completed pyclops futures, signalled through a file descriptor (see pyclops/completion_queue.hpp)", sizeof(completion_queue_object));
+    tobj->tp_new = cq_new;
+    tobj->tp_dealloc = cq_dealloc;
+    tobj->tp_methods = cq_methods;
+
+    if (PyType_Ready(tobj) < 0)
+	throw pyerr_occurred("pyclops::completion_queue_type");
+
+    ret = tobj;
+    return ret;
+}
+
+
+py_object completion_queue_type()
+{
+    return py_object::borrowed_reference((PyObject *) cq_type());
+}
+
+
+shared_ptr<completion_queue> completion_queue_from_python(const py_object &x, const char *where)
+{
+    if (!PyObject_TypeCheck(x.ptr, cq_type()))
+	throw runtime_error(string(where ? where : "pyclops") + ": expected pyclops.completion_queue object");
+
+    return *(reinterpret_cast<completion_queue_object *> (x.ptr)->q);
+}
+
+
+py_object completion_queue_to_python(const shared_ptr<completion_queue> &q)
+{
+    if (!q)
+	throw runtime_error("pyclops: empty shared_ptr<completion_queue> in to_python converter");
+
+    PyTypeObject *tp = cq_type();
+    completion_queue_object *cp = PyObject_New(completion_queue_object, tp);
+    if (!cp)
+	throw pyerr_occurred("pyclops::completion_queue_to_python");
+
+    cp->q = NULL;
+    py_object ret = py_object::new_reference(reinterpret_cast<PyObject *> (cp));
+    cp->q = new shared_ptr<completion_queue> (q);
+
+    return ret;
+}
+
+
+}  // namespace pyclops
@@ -75,4 +75,174 @@ print e.f(100)
 print e.g(100)
 print e.h("hi")
 
+print
+print 'Scalar converters'
+assert exm.add_int16(np.int16(3), np.int64(4)) == 7
+assert exm.boolean_not(np.bool_(True)) == False
+
+try:
+    exm.add_int16(40000, 0)
+    assert False, 'add_int16(40000, 0) should have raised an exception'
+except RuntimeError:
+    pass
+
+print 'Complex converters'
+assert exm.conj_complex(1+2j) == 1-2j
+assert exm.conj_complex(np.complex64(3-4j)) == 3+4j
+
+a = np.array([1+2j, 3+4j])
+v = exm.imag_view(a)
+assert list(v) == [2.0, 4.0]
+a[1] = 5+6j
+assert v[1] == 6.0   # view, not copy
+
+print 'Record arrays'
+e = exm.make_events(4)
+assert e.dtype.names == ('time', 'snr', 'beam')
+assert list(e['beam']) == [0, 1, 2, 3]
+assert exm.sum_snr(e) == 60.0
+
+print 'By-value returns'
+y = exm.make_Y(3)
+assert exm.Y_ncopies() == 0   # moved into the python object, not copied
+del y
+
+print 'unique_ptr and shared_ptr<const T>'
+x = exm.make_Xu(26)
+assert x.get() == 26
+assert exm.get_Xc(x) == 26
+del x
+
+print 'Intrusive refcounting'
+z = exm.make_Z(5)
+assert exm.clone_Z(z) is z
+exm.set_global_Z(z)
+del z
+assert exm.get_global_Z() == 5   # C++ intrusive_ptr outlives the python object
+exm.clear_global_Z()
+assert exm.Z(6).get() == 6
+
+print 'Property setters'
+y = exm.make_Y(3)
+assert list(y.v) == [1.0, 1.0, 1.0]
+y.v = np.arange(5.0)
+assert list(y.v) == [0.0, 1.0, 2.0, 3.0, 4.0]
+
+try:
+    y.v = np.array([1+2j])   # would drop the imaginary part
+    assert False, 'lossy assignment to Y.v should have raised an exception'
+except RuntimeError:
+    pass
+
+assert list(y.v) == [0.0, 1.0, 2.0, 3.0, 4.0]   # unchanged
+del y
+
+assert exm.sum_int8([1, 2, -3]) == 0
+assert exm.sum_int8(np.array([100, 27], dtype=np.int64)) == 127
+
+for v in ([300], [1.5], np.array([2**64-1], dtype=np.uint64)):
+    try:
+        exm.sum_int8(v)
+        assert False, 'sum_int8(%s) should have raised an exception' % v
+    except RuntimeError:
+        pass
+
+print 'Threaded generator'
+assert list(exm.count_threaded(10)) == range(10)
+chunks = list(exm.count_threaded(10, chunk_size=4))
+assert [ len(c) for c in chunks ] == [4, 4, 2]
+assert list(np.concatenate(chunks)) == range(10)
+
+print 'Futures'
+done = [ ]
+f = exm.slow_add(2, 3, seconds=0.1)
+f.add_done_callback(lambda f: done.append(f.result()))
+assert f.result() == 5
+assert f.done()
+
+import time
+time.sleep(0.1)
+assert done == [5]
+
+try:
+    exm.slow_add(1, 2, seconds=-1.0).result()
+    assert False, 'slow_add() with negative sleep time should have raised an exception'
+except RuntimeError:
+    pass
+
+print 'Container-like class'
+v = exm.V([0, 1, 2, 3])
+assert len(v) == 4
+assert (v[1], v[-1], v[-4]) == (1.0, 3.0, 0.0)
+
+for i in [4, -5]:
+    try:
+        v[i]
+        assert False, 'out-of-range index should have raised IndexError'
+    except IndexError:
+        pass
+
+v[-1] = 7
+assert list(v) == [0, 1, 2, 7]
+assert [ x for x in v ] == [0, 1, 2, 7]
+
+# Slices are numpy views, which write through to the C++ vector.
+a = v[1:3]
+assert isinstance(a, np.ndarray) and list(a) == [1, 2]
+a[0] = 10
+assert v[1] == 10
+v[::2] = [5, 6]
+assert list(v) == [5, 10, 6, 7]
+
+chunks = list(v.iter_chunks(3))
+assert [ list(c) for c in chunks ] == [[5, 10, 6], [7]]
+
+w = exm.V([5, 10, 6, 7])
+assert (v == w) and not (v != w)
+assert hash(v) == hash(w) and len(set([v, w])) == 1
+
+u = v + w
+assert list(u) == [10, 20, 12, 14] and list(v) == [5, 10, 6, 7]
+v0 = v
+v += w
+assert v is v0 and v == u and v != w
+
+print 'std::function arguments'
+assert abs(exm.integrate(lambda t: 2*t, 0, 1) - 1.0) < 1.0e-10
+assert abs(exm.integrate(exm.square, 0, 1) - 1.0/3.0) < 1.0e-6
+assert abs(exm.integrate(exm.X(3).scale, 0, 2) - 6.0) < 1.0e-10
+
+print 'Completion queue'
+import select
+cq = exm.completion_queue()
+for i in range(5):
+    cq.watch(exm.slow_add(i, 1, seconds=0.01*i))
+
+results = [ ]
+while len(results) < 5:
+    select.select([cq.fileno()], [], [], 1.0)
+    results += [ f.result() for f in cq.drain() ]
+
+assert sorted(results) == [1, 2, 3, 4, 5]
+
+print 'Sharing extension types between modules'
+import example_module2 as exm2
+x = exm.make_Xp(27)
+assert exm2.roundtrip_X(x) is x
+assert exm2.get_X2(x) == 27
+y = exm2.make_X2(28)
+assert type(y) is exm.X
+assert exm.get_Xp(y) == 28
+del x, y
+
+print 'Calling example_module functions through the C API'
+assert exm2.add_via_capi(2, 3) == 5
+assert exm2.make_tuple_via_capi() == exm.make_tuple()
+
+try:
+    exm2.bad_capi_lookup()
+    assert False, 'capi_function with mismatched signature should have raised an exception'
+except RuntimeError:
+    pass
+
 print 'All done!'
@@ -1,9 +1,14 @@
 // Suggest #including pyclops first, to avoid gcc warning "_POSIX_C_SOURCE redefined"
 #include "pyclops.hpp"
 
+#include <thread>
+#include <chrono>
+#include <complex>
 #include <sstream>
 #include <iostream>
 
+#include "example_module.hpp"
+
 using namespace std;
 using namespace pyclops;
 
@@ -108,17 +113,7 @@ static void print_float(double x)
 // -------------------------------------------------------------------------------------------------
 
 
-struct X {
-    ssize_t x;    
-    X(ssize_t x_) : x(x_) { cout << "    X::X(" << x << ") " << this << endl; }
-    X(const X &x_) : x(x_.x) { cout << "    X::X(" << x << ") " << this << endl; }
-    ~X() { cout << "    X::~X(" << x << ") " << this << endl; }
-    ssize_t get() const { return x; }
-    static double sm(double x, double y) { return x+y; }   // example staticmethod
-};
-
-
-// Declare X type object.
+// Declare X type object.  (struct X is defined in example_module.hpp, since it's also used by example_module2.)
 static extension_type<X> X_type("X", "The awesome X class");
 
 namespace pyclops {
@@ -267,6 +262,234 @@ static string f_kwargs(int a, int b, int c=2, int d=3)
     return ss.str();
 }
 
+// -------------------------------------------------------------------------------------------------
+//
+// Scalar converters: numpy scalars are accepted, and integer conversions are range-checked.
+
+
+static int16_t add_int16(int16_t x, int16_t y) { return x+y; }
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// std::complex, and zero-copy views of the real and imaginary parts of complex arrays.
+
+
+static complex<double> conj_complex(complex<double> z) { return std::conj(z); }
+
+static in_array<double> imag_view(in_array<complex<double>> a) { return imag_part(a); }
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Record types: std::vector<Event> converts to/from a 1-d structured array.
+
+
+struct Event {
+    double time;
+    float snr;
+    int beam;
+};
+
+namespace pyclops {
+    template<> struct record<Event> {
+	static void fields(record_fields<Event> &f)
+	{
+	    f.add("time", &Event::time);
+	    f.add("snr", &Event::snr);
+	    f.add("beam", &Event::beam);
+	}
+    };
+}
+
+static vector<Event> make_events(ssize_t n)
+{
+    vector<Event> ret(n);
+
+    for (ssize_t i = 0; i < n; i++) {
+	ret[i].time = 0.5 * i;
+	ret[i].snr = 10 * i;
+	ret[i].beam = i;
+    }
+
+    return ret;
+}
+
+static double sum_snr(const vector<Event> &v)
+{
+    double ret = 0.0;
+    for (const Event &e: v)
+	ret += e.snr;
+    return ret;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Y: counts its copies, to check that by-value returns are moved (not copied) into python objects.
+
+
+struct Y {
+    static ssize_t ncopies;
+
+    vector<double> v;
+
+    Y(ssize_t n) : v(n, 1.0) { }
+    Y(const Y &y) : v(y.v) { ncopies++; }
+    Y(Y &&y) = default;
+};
+
+ssize_t Y::ncopies = 0;
+
+static extension_type<Y> Y_type("Y", "Counts its copies, and has a read-write std::vector property");
+
+namespace pyclops {
+    template<> struct xconverter<Y> { static constexpr extension_type<Y> *type = &Y_type; };
+}
+
+static Y make_Y(ssize_t n) { return Y(n); }
+static ssize_t Y_ncopies() { return Y::ncopies; }
+
+// std::vector arguments are converted with the same range checks as the 'v' property.
+static ssize_t sum_int8(const vector<int8_t> &v)
+{
+    ssize_t ret = 0;
+    for (int8_t x: v)
+	ret += x;
+    return ret;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Z: intrusive refcounting, so a C++ intrusive_ptr<Z> can outlive the python object.
+
+
+struct Z : public intrusive_refcounted<Z> {
+    ssize_t z;
+    Z(ssize_t z_) : z(z_) { }
+    ssize_t get() const { return z; }
+};
+
+static extension_type<Z> Z_type("Z", "An intrusively refcounted class");
+
+namespace pyclops {
+    template<> struct xconverter<Z> { static constexpr extension_type<Z> *type = &Z_type; };
+}
+
+static intrusive_ptr<Z> make_Z(ssize_t z) { return make_intrusive<Z> (z); }
+static intrusive_ptr<Z> clone_Z(intrusive_ptr<Z> z) { return z; }
+
+static intrusive_ptr<Z> g_Z;
+static void set_global_Z(intrusive_ptr<Z> z) { g_Z = z; }
+static ssize_t get_global_Z() { return g_Z ? g_Z->get() : -1; }
+static void clear_global_Z() { g_Z.reset(); }
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// V: a container-like class.  Its python type gets len(), indexing and slicing, ==/hash, +/+=,
+// and iteration (including iter_chunks()) from the C++ operators (see pyclops/extension_type.hpp),
+// without any add_method() calls.
+
+
+struct V {
+    vector<double> v;
+
+    V(const vector<double> &v_) : v(v_) { }
+
+    ssize_t size() const { return v.size(); }
+    double &operator[](ssize_t i) { return v[i]; }
+    const double &operator[](ssize_t i) const { return v[i]; }
+    double *data() { return &v[0]; }
+
+    vector<double>::iterator begin() { return v.begin(); }
+    vector<double>::iterator end() { return v.end(); }
+
+    bool operator==(const V &w) const { return v == w.v; }
+
+    V &operator+=(const V &w)
+    {
+	if (w.size() != size())
+	    throw runtime_error("V: size mismatch in +=");
+	for (ssize_t i = 0; i < size(); i++)
+	    v[i] += w.v[i];
+	return *this;
+    }
+
+    V operator+(const V &w) const { V ret(*this); ret += w; return ret; }
+};
+
+namespace std {
+    template<> struct hash<V> {
+	size_t operator()(const V &x) const
+	{
+	    size_t ret = x.v.size();
+	    for (double d: x.v)
+		ret = 31*ret + hash<double>()(d);
+	    return ret;
+	}
+    };
+}
+
+static extension_type<V> V_type("V", "A container-like class (sequence, number, and iterator slots)");
+
+namespace pyclops {
+    template<> struct xconverter<V> { static constexpr extension_type<V> *type = &V_type; };
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Threaded generator: the producer runs on a background thread.
+
+
+// If chunk_size > 0, python gets numpy arrays of up to chunk_size items.
+static threaded_generator<ssize_t> count_threaded(ssize_t n, ssize_t chunk_size)
+{
+    auto i = make_shared<ssize_t> (0);
+    return threaded_generator<ssize_t> ([i,n](ssize_t &x) { x = (*i)++; return x < n; }, 4, chunk_size);
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// std::function arguments (see pyclops/function_converters.hpp).  If integrate() is called with a
+// python callable, each evaluation of f() is an upcall into python.  If it is called with a wrapped
+// C++ function (e.g. square) or bound method (e.g. X.scale), then f() is called directly.
+
+
+static double integrate(std::function<double(double)> f, double lo, double hi)
+{
+    const ssize_t n = 1000;
+    const double dx = (hi - lo) / n;
+
+    // Midpoint rule.
+    double ret = 0.0;
+    for (ssize_t i = 0; i < n; i++)
+	ret += f(lo + (i+0.5) * dx);
+
+    return ret * dx;
+}
+
+static double square(double x) { return x*x; }
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Futures: wrap_func_async() runs the C++ function on a worker thread.
+
+
+static double slow_add(double x, double y, double seconds)
+{
+    if (seconds < 0.0)
+	throw runtime_error("slow_add: negative sleep time");
+
+    std::this_thread::sleep_for(std::chrono::duration<double> (seconds));
+    return x+y;
+}
+
+
 // -------------------------------------------------------------------------------------------------
 
 
@@ -306,6 +529,9 @@ PyMODINIT_FUNC initexample_module(void)
     std::function<ssize_t(X*)> X_get2 = [](X *x) { return x->get(); };
     X_type.add_method("get2", "get(), wrapped via std::function", wrap_method(X_get2));
 
+    std::function<double(X*,double)> X_scale = [](X *x, double t) { return x->x * t; };
+    X_type.add_method("scale", "returns x*t", wrap_method(X_scale, "t"));
+
     std::function<ssize_t(const X *x)> X_xget = [](const X *x) { return x->x; };
     X_type.add_property("xget", "get x!", X_xget);
 
@@ -365,5 +591,77 @@ PyMODINIT_FUNC initexample_module(void)
 
     m.add_function("f_kwargs", wrap_func(f_kwargs, "a", "b", kwarg("c",2), kwarg("d",3)));
 
+    // ----------------------------------------------------------------------
+
+    m.add_function("add_int16", wrap_func(add_int16, "x", "y"));
+
+    // ----------------------------------------------------------------------
+
+    m.add_function("conj_complex", wrap_func(conj_complex, "z"));
+    m.add_function("imag_view", wrap_func(imag_view, "a"));
+
+    // ----------------------------------------------------------------------
+
+    m.add_function("make_events", wrap_func(make_events, "n"));
+    m.add_function("sum_snr", wrap_func(sum_snr, "v"));
+
+    // ----------------------------------------------------------------------
+
+    std::function<Y* (ssize_t)> Y_init = [](ssize_t n) { return new Y(n); };
+    Y_type.add_constructor(wrap_constructor(Y_init, "n"));
+
+    // The 'v' property is read-write, and assignment resizes the existing vector in place.
+    std::function<vector<double>& (Y *)> Y_v = [](Y *y) -> vector<double> & { return y->v; };
+    Y_type.add_property("v", "read-write std::vector property", Y_v);
+
+    m.add_type(Y_type);
+    m.add_function("make_Y", wrap_func(make_Y, "n"));
+    m.add_function("Y_ncopies", wrap_func(Y_ncopies));
+    m.add_function("sum_int8", wrap_func(sum_int8, "v"));
+
+    // ----------------------------------------------------------------------
+
+    // unique_ptr<X> returns are adopted by a python-managed object, and shared_ptr<const X> arguments are accepted.
+    std::function<unique_ptr<X>(ssize_t)> make_Xu = [](ssize_t i) { return unique_ptr<X> (new X(i)); };
+    std::function<ssize_t(shared_ptr<const X>)> get_Xc = [](shared_ptr<const X> x) { return x->get(); };
+
+    m.add_function("make_Xu", wrap_func(make_Xu, "i"));
+    m.add_function("get_Xc", wrap_func(get_Xc, "x"));
+
+    // ----------------------------------------------------------------------
+
+    std::function<Z* (ssize_t)> Z_init = [](ssize_t z) { return new Z(z); };
+
+    Z_type.add_constructor(wrap_constructor(Z_init, "z"));
+    Z_type.add_method("get", "get z", wrap_method(&Z::get));
+
+    m.add_type(Z_type);
+    m.add_function("make_Z", wrap_func(make_Z, "z"));
+    m.add_function("clone_Z", wrap_func(clone_Z, "z"));
+    m.add_function("set_global_Z", wrap_func(set_global_Z, "z"));
+    m.add_function("get_global_Z", wrap_func(get_global_Z));
+    m.add_function("clear_global_Z", wrap_func(clear_global_Z));
+
+    // ----------------------------------------------------------------------
+
+    std::function<V* (const vector<double> &)> V_init = [](const vector<double> &v) { return new V(v); };
+
+    V_type.add_constructor(wrap_constructor(V_init, "v"));
+    m.add_type(V_type);
+
+    // ----------------------------------------------------------------------
+
+    m.add_function("count_threaded", wrap_func(count_threaded, "n", kwarg("chunk_size",0)));
+
+    // ----------------------------------------------------------------------
+
+    m.add_function("integrate", "integrate f over [lo,hi]", wrap_func(integrate, "f", "lo", "hi"));
+    m.add_function("square", wrap_func(square, "x"));
+
+    // ----------------------------------------------------------------------
+
+    m.add_function("slow_add", "returns x+y after sleeping (returns future)", wrap_func_async(slow_add, "x", "y", kwarg("seconds",0.0)));
+    m.add_object("completion_queue", completion_queue_type());
+
     m.finalize();
 }
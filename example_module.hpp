@@ -0,0 +1,22 @@
+#ifndef _EXAMPLE_MODULE_HPP
+#define _EXAMPLE_MODULE_HPP
+
+#include <iostream>
+#include <sys/types.h>
+
+
+// C++ types which are shared between example_module and example_module2 (see example_module2.cpp).
+// A module which imports an extension type from another module needs the same C++ definition.
+
+
+struct X {
+    ssize_t x;    
+    X(ssize_t x_) : x(x_) { std::cout << "    X::X(" << x << ") " << this << std::endl; }
+    X(const X &x_) : x(x_.x) { std::cout << "    X::X(" << x << ") " << this << std::endl; }
+    ~X() { std::cout << "    X::~X(" << x << ") " << this << std::endl; }
+    ssize_t get() const { return x; }
+    static double sm(double x, double y) { return x+y; }   // example staticmethod
+};
+
+
+#endif  // _EXAMPLE_MODULE_HPP
@@ -0,0 +1,66 @@
+// Second example module, which uses the extension type X from example_module (see pyclops/type_registry.hpp),
+// and calls functions in example_module through its C API capsule (see pyclops/capi.hpp).
+// Both modules must be linked against the same libpyclops.so.
+
+// Suggest #including pyclops first, to avoid gcc warning "_POSIX_C_SOURCE redefined"
+#include "pyclops.hpp"
+
+#include "example_module.hpp"
+
+using namespace std;
+using namespace pyclops;
+
+
+// The xconverter points to the extension_type in example_module (initialized in initexample_module2() below).
+namespace pyclops {
+    template<> struct xconverter<X> { static extension_type<X> *type; };
+}
+
+extension_type<X> *pyclops::xconverter<X>::type = nullptr;
+
+
+static shared_ptr<X> make_X2(ssize_t i) { return make_shared<X> (i); }
+static shared_ptr<X> roundtrip_X(shared_ptr<X> x) { return x; }
+static ssize_t get_X2(shared_ptr<const X> x) { return x->get(); }
+
+
+// C API functions from example_module (initialized in initexample_module2() below).
+// example_module.add() is a plain function pointer, and example_module.make_tuple() is a std::function.
+static capi_function<int(int,int)> capi_add;
+static capi_function<py_tuple()> capi_make_tuple;
+
+static int add_via_capi(int x, int y) { return capi_add(x, y); }
+static py_tuple make_tuple_via_capi() { return capi_make_tuple(); }
+
+// Throws an exception, since example_module.add() has signature int(int,int).
+static void bad_capi_lookup()
+{
+    capi_function<double(double,double)> f("example_module", "add");
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+PyMODINIT_FUNC initexample_module2(void)
+{
+    import_array();
+
+    // Imports example_module if necessary.
+    xconverter<X>::type = import_extension_type<X> ("example_module.X");
+
+    capi_add = capi_function<int(int,int)> ("example_module", "add");
+    capi_make_tuple = capi_function<py_tuple()> ("example_module", "make_tuple");
+
+    extension_module m("example_module2", "Example module which uses types from example_module");
+
+    m.add_function("make_X2", wrap_func(make_X2, "i"));
+    m.add_function("roundtrip_X", wrap_func(roundtrip_X, "x"));
+    m.add_function("get_X2", wrap_func(get_X2, "x"));
+
+    m.add_function("add_via_capi", wrap_func(add_via_capi, "x", "y"));
+    m.add_function("make_tuple_via_capi", wrap_func(make_tuple_via_capi));
+    m.add_function("bad_capi_lookup", wrap_func(bad_capi_lookup));
+
+    m.finalize();
+}
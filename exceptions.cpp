@@ -1,5 +1,6 @@
 #define NO_IMPORT_ARRAY
 #include "pyclops/internals.hpp"
+#include "pyclops/probes.hpp"
 #include <frameobject.h>
 
 using namespace std;
@@ -237,8 +238,10 @@ static shared_ptr<const char> get_exception_text()
 
 pyerr_occurred::pyerr_occurred(const char *where_)
 {
-    // FIXME 'where' argument currently ignored.
+    // FIXME 'where' argument currently ignored (except by the probe).
     this->msg = get_exception_text();
+
+    PYCLOPS_PROBE2(pyerr_occurred, where_ ? where_ : "", msg ? msg.get() : "");
 }
 
 // virtual
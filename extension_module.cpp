@@ -1,5 +1,6 @@
 #define NO_IMPORT_ARRAY
 #include "pyclops/internals.hpp"
+#include "pyclops/capi.hpp"
 
 using namespace std;
 
@@ -9,6 +10,31 @@ namespace pyclops {
 #endif
 
 
+PyTypeObject *_make_static_type(const char *name, const char *doc, ssize_t basicsize)
+{
+    // This is probably silly, but I decided to overallocate the PyTypeObject to avoid
+    // a possible segfault if the python interpreter gets recompiled with -DCOUNT_ALLOCS.
+    ssize_t nalloc = sizeof(PyTypeObject) + 128;
+    PyTypeObject *tobj = (PyTypeObject *) malloc(nalloc);
+    if (!tobj)
+	throw bad_alloc();
+
+    memset(tobj, 0, nalloc);
+
+    // Idiomatic initialization produces superfluous warnings with gcc5
+    // PyObject_INIT((PyVarObject *) tobj, NULL);
+
+    // This initialization is equivalent (see Include/objimpl.h in python interpreter source code)
+    _Py_NewReference((PyObject *) tobj);
+
+    tobj->tp_name = name;
+    tobj->tp_doc = doc;
+    tobj->tp_flags = Py_TPFLAGS_DEFAULT;
+    tobj->tp_basicsize = basicsize;
+    return tobj;
+}
+
+
 extension_module::extension_module(const string &name, const string &docstring) :
     module_name(name),
     module_docstring(docstring)
@@ -25,11 +51,16 @@ void extension_module::add_function(const string &func_name, const string &func_
 
     PyMethodDef m;
     m.ml_name = strdup(func_name.c_str());
-    m.ml_meth = make_kwargs_cfunction(func);
+    m.ml_meth = make_kwargs_cfunction(func, m.ml_name);
     m.ml_flags = METH_VARARGS | METH_KEYWORDS;
     m.ml_doc = strdup(func_docstring.c_str());
 
     this->module_methods.push_back(m);
+
+    // Functions returned by wrap_func() remember the original C++ callable.
+    const _wrapped_func *w = func.target<_wrapped_func> ();
+    if (w && w->cpp_func)
+	this->capi_functions.push_back({ func_name, w->cpp_func });
 }
 
 
@@ -39,6 +70,15 @@ void extension_module::add_function(const string &func_name, std::function<py_ob
 }
 
 
+void extension_module::add_object(const string &name, const py_object &obj)
+{
+    if (finalized)
+	throw runtime_error("pyclops: extension_module::add_object() called after extension_module::finalize()");
+
+    this->module_objects.push_back({ name, obj });
+}
+
+
 void extension_module::finalize()
 {
     if (finalized)
@@ -71,6 +111,14 @@ void extension_module::finalize()
 	PyModule_AddObject(m, t->tp_name, (PyObject *) t);
     }
 
+    for (const auto &p: module_objects) {
+	// PyModule_AddObject() steals a reference.
+	Py_INCREF(p.second.ptr);
+	PyModule_AddObject(m, p.first.c_str(), p.second.ptr);
+    }
+
+    _capi_publish(m, module_name, capi_functions);
+
     this->finalized = true;
 }
 
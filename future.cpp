@@ -0,0 +1,374 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/future.hpp"
+#include "pyclops/completion_queue.hpp"
+#include "pyclops/gil_stats.hpp"
+
+#include <chrono>
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// future_state
+
+
+void future_state::set_result(const std::function<py_object()> &convert_)
+{
+    {
+	lock_guard<mutex> l(lock);
+	convert = convert_;
+    }
+    _complete();
+}
+
+
+void future_state::set_exception(std::exception_ptr e)
+{
+    {
+	lock_guard<mutex> l(lock);
+	error = e;
+    }
+    _complete();
+}
+
+
+void future_state::_complete()
+{
+    bool has_callbacks;
+    vector<shared_ptr<completion_queue>> qs;
+
+    {
+	lock_guard<mutex> l(lock);
+	done = true;
+	has_callbacks = !callbacks.empty();
+	std::swap(qs, queues);
+    }
+
+    cv.notify_all();
+
+    // Lock-free, doesn't need the GIL.
+    for (const shared_ptr<completion_queue> &q: qs)
+	q->post(shared_from_this());
+
+    if (!has_callbacks)
+	return;
+
+    // Since 'done' is set, no more callbacks can be added.
+    _gil_upcall_timer t;   // see pyclops/gil_stats.hpp
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    t.acquired("future.callbacks");
+
+    {
+	vector<py_object> cbs;
+	std::swap(cbs, callbacks);
+
+	py_object s = self;
+	self = py_object();
+
+	for (const py_object &cb: cbs) {
+	    PyObject *r = PyObject_CallFunctionObjArgs(cb.ptr, s.ptr, NULL);
+	    if (!r)
+		PyErr_WriteUnraisable(cb.ptr);
+	    Py_XDECREF(r);
+	}
+    }  // drop references before releasing the GIL
+
+    t.stop();
+    PyGILState_Release(gstate);
+}
+
+
+bool future_state::wait(double timeout)
+{
+    {
+	lock_guard<mutex> l(lock);
+	if (done)
+	    return true;
+    }
+
+    bool ret;
+
+    PYCLOPS_BEGIN_ALLOW_THREADS
+    {
+	unique_lock<mutex> l(lock);
+
+	if (timeout < 0) {
+	    cv.wait(l, [this] { return done; });
+	    ret = true;
+	}
+	else
+	    ret = cv.wait_for(l, chrono::duration<double> (timeout), [this] { return done; });
+    }  // release lock before reacquiring GIL
+    PYCLOPS_END_ALLOW_THREADS
+
+    return ret;
+}
+
+
+py_object future_state::get_result()
+{
+    // The worker thread no longer modifies 'error' or 'convert' after setting 'done'.
+    if (error)
+	std::rethrow_exception(error);
+
+    if (!pyerr_type.is_none()) {
+	_restore_pyerr();
+	throw pyerr_occurred("future.result()");
+    }
+
+    if (!converted) {
+	std::function<py_object()> c;
+	std::swap(c, convert);
+
+	// The C++ return value may have been moved from, so conversion can't be retried.
+	// If it raised a python exception, we save the exception itself, since a saved
+	// pyerr_occurred can't be rethrown once the python error indicator has been consumed.
+	try {
+	    result = c();
+	} catch (pyerr_occurred &) {
+	    _save_pyerr();
+	    if (pyerr_type.is_none())
+		error = std::current_exception();   // shouldn't happen (no python error was set)
+	    _restore_pyerr();
+	    throw;
+	} catch (...) {
+	    error = std::current_exception();
+	    throw;
+	}
+
+	converted = true;
+    }
+
+    return result;
+}
+
+
+void future_state::_save_pyerr()
+{
+    PyObject *t, *v, *tb;
+    PyErr_Fetch(&t, &v, &tb);
+
+    if (!t)
+	return;
+
+    PyErr_NormalizeException(&t, &v, &tb);
+
+    pyerr_type = py_object::new_reference(t);
+    pyerr_value = v ? py_object::new_reference(v) : py_object();
+    pyerr_traceback = tb ? py_object::new_reference(tb) : py_object();
+}
+
+
+void future_state::_restore_pyerr()
+{
+    if (pyerr_type.is_none())
+	return;
+
+    PyObject *t = pyerr_type.ptr;
+    PyObject *v = pyerr_value.ptr;
+    PyObject *tb = pyerr_traceback.is_none() ? NULL : pyerr_traceback.ptr;
+
+    // PyErr_Restore() steals references.
+    Py_INCREF(t);
+    Py_INCREF(v);
+    Py_XINCREF(tb);
+    PyErr_Restore(t, v, tb);
+}
+
+
+void future_state::add_queue(const shared_ptr<completion_queue> &q, const py_object &self_)
+{
+    {
+	lock_guard<mutex> l(lock);
+
+	// Released by the python completion_queue.drain() (see completion_queue.cpp).
+	queued_self = self_;
+	queued_count++;
+
+	if (!done) {
+	    queues.push_back(q);
+	    return;
+	}
+    }
+
+    q->post(shared_from_this());
+}
+
+
+shared_ptr<future_state> make_future_state()
+{
+    // Worker threads call PyGILState_Ensure(), which requires python threads to be initialized.
+    PyEval_InitThreads();
+
+    return shared_ptr<future_state> (new future_state, [](future_state *p)
+	{
+	    PyGILState_STATE gstate = PyGILState_Ensure();
+	    delete p;
+	    PyGILState_Release(gstate);
+	});
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// The python future object.
+
+
+struct future_object {
+    PyObject_HEAD
+
+    // Allocated with new(), and deleted when the future is deallocated.
+    shared_ptr<future_state> *state;
+};
+
+
+static void future_dealloc(PyObject *self)
+{
+    future_object *fp = reinterpret_cast<future_object *> (self);
+
+    delete fp->state;
+    fp->state = NULL;
+    PyObject_Del(self);
+}
+
+
+static PyObject *future_done(PyObject *self, PyObject *args)
+{
+    future_state *s = reinterpret_cast<future_object *> (self)->state->get();
+
+    lock_guard<mutex> l(s->lock);
+    return PyBool_FromLong(s->done);
+}
+
+
+static PyObject *future_result(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "timeout", NULL };
+    PyObject *timeout_obj = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", (char **) kwlist, &timeout_obj))
+	return NULL;
+
+    try {
+	future_state *s = reinterpret_cast<future_object *> (self)->state->get();
+	double timeout = -1.0;
+
+	if (timeout_obj != Py_None) {
+	    timeout = PyFloat_AsDouble(timeout_obj);
+	    if ((timeout == -1.0) && PyErr_Occurred())
+		return NULL;
+	    timeout = max(timeout, 0.0);
+	}
+
+	if (!s->wait(timeout))
+	    throw runtime_error("pyclops.future.result(): timed out");
+
+	py_object r = s->get_result();
+
+	PyObject *ret = r.ptr;
+	r.ptr = NULL;  // steal reference
+	return ret;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+static PyObject *future_add_done_callback(PyObject *self, PyObject *args)
+{
+    PyObject *cb = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &cb))
+	return NULL;
+
+    if (!PyCallable_Check(cb)) {
+	PyErr_SetString(PyExc_TypeError, "pyclops.future.add_done_callback(): argument must be callable");
+	return NULL;
+    }
+
+    future_state *s = reinterpret_cast<future_object *> (self)->state->get();
+
+    {
+	lock_guard<mutex> l(s->lock);
+
+	if (!s->done) {
+	    s->callbacks.push_back(py_object::borrowed_reference(cb));
+	    s->self = py_object::borrowed_reference(self);
+	    Py_RETURN_NONE;
+	}
+    }
+
+    // Already done: call immediately.
+    PyObject *r = PyObject_CallFunctionObjArgs(cb, self, NULL);
+    if (!r)
+	PyErr_WriteUnraisable(cb);
+    Py_XDECREF(r);
+
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef future_methods[] = {
+    { "done", (PyCFunction) future_done, METH_NOARGS, "Returns True if the C++ call has completed" },
+    { "result", (PyCFunction) future_result, METH_VARARGS | METH_KEYWORDS, "result(timeout=None): waits for the C++ call, and returns its (converted) return value" },
+    { "add_done_callback", (PyCFunction) future_add_done_callback, METH_VARARGS, "add_done_callback(fn): calls fn(future) when the C++ call completes" },
+    { NULL, NULL, 0, NULL }
+};
+
+
+static PyTypeObject *future_type()
+{
+    static PyTypeObject *ret = nullptr;
+
+    if (ret)
+	return ret;
+
+    PyTypeObject *tobj = _make_static_type("pyclops.future", "Result of a C++ call running on a pyclops worker thread (see pyclops/future.hpp)", sizeof(future_object));
+    tobj->tp_dealloc = future_dealloc;
+    tobj->tp_methods = future_methods;
+
+    if (PyType_Ready(tobj) < 0)
+	throw pyerr_occurred("pyclops::future_type");
+
+    ret = tobj;
+    return ret;
+}
+
+
+py_object make_python_future(const shared_ptr<future_state> &state)
+{
+    PyTypeObject *tp = future_type();
+    future_object *fp = PyObject_New(future_object, tp);
+    if (!fp)
+	throw pyerr_occurred("pyclops::make_python_future");
+
+    fp->state = NULL;
+    py_object ret = py_object::new_reference(reinterpret_cast<PyObject *> (fp));
+    fp->state = new shared_ptr<future_state> (state);
+
+    return ret;
+}
+
+
+shared_ptr<future_state> future_state_from_python(const py_object &x, const char *where)
+{
+    if (!PyObject_TypeCheck(x.ptr, future_type()))
+	throw runtime_error(string(where ? where : "pyclops") + ": expected pyclops.future object");
+
+    return *(reinterpret_cast<future_object *> (x.ptr)->state);
+}
+
+
+}  // namespace pyclops
@@ -0,0 +1,118 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/generator.hpp"
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// The python iterator object returned by make_python_generator().
+
+
+struct generator_object {
+    PyObject_HEAD
+
+    // Allocated with new(), and deleted when the generator is exhausted (or deallocated).
+    // If NULL, the generator is exhausted.
+    std::function<bool(py_object &)> *next;
+
+    // Set while the callback is running, to catch reentrant calls to next() (e.g. from an upcall),
+    // which could otherwise delete the callback while it's still running.
+    bool running;
+};
+
+
+static void generator_dealloc(PyObject *self)
+{
+    generator_object *gp = reinterpret_cast<generator_object *> (self);
+
+    delete gp->next;
+    gp->next = NULL;
+    PyObject_Del(self);
+}
+
+
+static PyObject *generator_iternext(PyObject *self)
+{
+    generator_object *gp = reinterpret_cast<generator_object *> (self);
+
+    if (gp->running) {
+	// Same behavior as python generators.
+	PyErr_SetString(PyExc_ValueError, "generator already executing");
+	return NULL;
+    }
+
+    if (!gp->next)
+	return NULL;  // StopIteration (no exception needs to be set)
+
+    gp->running = true;
+
+    try {
+	py_object ret;
+
+	if ((*gp->next)(ret)) {
+	    gp->running = false;
+	    PyObject *p = ret.ptr;
+	    ret.ptr = NULL;  // steal reference
+	    return p;
+	}
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+    }
+
+    gp->running = false;
+
+    // If we get here, either the producer is exhausted, or an exception was thrown.
+    // In both cases, we release the callback (and any resources it holds) immediately.
+    delete gp->next;
+    gp->next = NULL;
+    return NULL;
+}
+
+
+static PyTypeObject *generator_type()
+{
+    static PyTypeObject *ret = nullptr;
+
+    if (ret)
+	return ret;
+
+    PyTypeObject *tobj = _make_static_type("pyclops.generator", "Python iterator which resumes a C++ producer (see pyclops/generator.hpp)", sizeof(generator_object));
+    tobj->tp_dealloc = generator_dealloc;
+    tobj->tp_iter = PyObject_SelfIter;
+    tobj->tp_iternext = generator_iternext;
+
+    if (PyType_Ready(tobj) < 0)
+	throw pyerr_occurred("pyclops::generator_type");
+
+    ret = tobj;
+    return ret;
+}
+
+
+py_object make_python_generator(const std::function<bool(py_object &)> &next)
+{
+    PyTypeObject *tp = generator_type();
+    generator_object *gp = PyObject_New(generator_object, tp);
+    if (!gp)
+	throw pyerr_occurred("pyclops::make_python_generator");
+
+    gp->next = NULL;
+    gp->running = false;
+    py_object ret = py_object::new_reference(reinterpret_cast<PyObject *> (gp));
+    gp->next = new std::function<bool(py_object &)> (next);
+
+    return ret;
+}
+
+
+}  // namespace pyclops
@@ -0,0 +1,162 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/gil_stats.hpp"
+
+#include <map>
+#include <cstring>
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+atomic<bool> _gil_stats_enabled(_getenv_flag("PYCLOPS_GIL_STATS"));
+thread_local gil_stats *_gil_current = nullptr;
+thread_local int64_t _gil_released_ns = 0;
+
+// Sites are never unregistered, since cfunction_table entries and upcall sites hold bare pointers.
+static map<string, gil_stats *> *all_gil_stats = nullptr;
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// gil_stats
+
+
+gil_stats::gil_stats(const string &name_) :
+    name(name_)
+{
+    reset();
+}
+
+
+void gil_stats::reset()
+{
+    nwait = wait_ns = max_wait_ns = 0;
+    nhold = hold_ns = max_hold_ns = 0;
+    memset(wait_histogram, 0, sizeof(wait_histogram));
+    memset(hold_histogram, 0, sizeof(hold_histogram));
+}
+
+
+void gil_stats::add_wait(int64_t dt)
+{
+    dt = max(dt, int64_t(0));
+    wait_histogram[_log2_bucket(dt, nbuckets)]++;
+    nwait++;
+    wait_ns += dt;
+    max_wait_ns = max(max_wait_ns, dt);
+}
+
+
+void gil_stats::add_hold(int64_t dt)
+{
+    dt = max(dt, int64_t(0));
+    hold_histogram[_log2_bucket(dt, nbuckets)]++;
+    nhold++;
+    hold_ns += dt;
+    max_hold_ns = max(max_hold_ns, dt);
+}
+
+
+gil_stats *make_gil_stats(const string &name)
+{
+    if (!all_gil_stats)
+	all_gil_stats = new map<string, gil_stats *> ();
+
+    gil_stats *&ret = (*all_gil_stats)[name];
+
+    if (!ret)
+	ret = new gil_stats(name);
+
+    return ret;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+void _gil_reacquired(int64_t t0, int64_t t1)
+{
+    int64_t t2 = _call_stats_now();
+    _gil_released_ns += t2 - t0;
+
+    gil_stats *s = _gil_current ? _gil_current : make_gil_stats("(other)");
+    s->add_wait(t2 - t1);
+}
+
+
+gil_stats *_gil_upcall_site(PyObject *f)
+{
+    PyObject *n = PyObject_GetAttrString(f, "__name__");
+
+    if (!n || !PyString_Check(n)) {
+	// E.g. a callable class instance.
+	PyErr_Clear();
+	Py_XDECREF(n);
+	return make_gil_stats(string("upcall:") + Py_TYPE(f)->tp_name);
+    }
+
+    gil_stats *ret = make_gil_stats(string("upcall:") + PyString_AsString(n));
+    Py_DECREF(n);
+    return ret;
+}
+
+
+gil_stats *_gil_upcall_site(const py_object &self, const char *method_name)
+{
+    return make_gil_stats(string(Py_TYPE(self.ptr)->tp_name) + "." + method_name);
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+void enable_gil_stats(bool on)
+{
+    _gil_stats_enabled.store(on, memory_order_relaxed);
+}
+
+
+void reset_gil_stats()
+{
+    if (all_gil_stats)
+	for (auto &p: *all_gil_stats)
+	    p.second->reset();
+}
+
+
+py_dict get_gil_stats()
+{
+    py_dict ret;
+
+    if (!all_gil_stats)
+	return ret;
+
+    for (const auto &p: *all_gil_stats) {
+	const gil_stats *s = p.second;
+
+	// Sites which were never reached (e.g. functions which were never called) are omitted.
+	if ((s->nwait == 0) && (s->nhold == 0))
+	    continue;
+
+	py_dict d;
+	d.set_item("nwait", converter<ssize_t>::to_python(s->nwait));
+	d.set_item("wait_ns", converter<ssize_t>::to_python(s->wait_ns));
+	d.set_item("max_wait_ns", converter<ssize_t>::to_python(s->max_wait_ns));
+	d.set_item("wait", _histogram_to_python(s->wait_histogram, gil_stats::nbuckets, "pyclops::get_gil_stats"));
+	d.set_item("nhold", converter<ssize_t>::to_python(s->nhold));
+	d.set_item("hold_ns", converter<ssize_t>::to_python(s->hold_ns));
+	d.set_item("max_hold_ns", converter<ssize_t>::to_python(s->max_hold_ns));
+	d.set_item("hold", _histogram_to_python(s->hold_histogram, gil_stats::nbuckets, "pyclops::get_gil_stats"));
+	ret.set_item(s->name, d);
+    }
+
+    return ret;
+}
+
+
+}  // namespace pyclops
@@ -1,12 +1,12 @@
 #define NO_IMPORT_ARRAY
 #include "pyclops/core.hpp"
+#include "pyclops/probes.hpp"
 
 #include <vector>
 #include <algorithm>
 #include <unordered_map>
 
-// To enable some verbose debugging output, turn this on!
-#define PYCLOPS_MASTER_HASH_TABLE_DEBUG 0
+// For debugging, the hash table operations can be traced with the hash_table_* probes (see pyclops/probes.hpp).
 
 using namespace std;
 
@@ -23,9 +23,7 @@ static unordered_map<const void*, PyObject*> master_hash_table;
 
 void master_hash_table_add(const void *cptr, PyObject *pptr)
 {
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_add() called: " << cptr << " -> " << pptr << endl;
-#endif
+    PYCLOPS_PROBE2(hash_table_add, cptr, pptr);
 
     if (!cptr || !pptr)
 	throw runtime_error("pyclops: internal error: null pointer in master_hash_table_add()");
@@ -35,19 +33,12 @@ void master_hash_table_add(const void *cptr, PyObject *pptr)
 	throw runtime_error("pyclops: internal error in master_hash_table_add(): entry already exists");
 
     master_hash_table[cptr] = pptr;
-
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_add(): success.  Current hash table follows." << endl;
-    master_hash_table_print();
-#endif
 }
 
 
 void master_hash_table_remove(const void *cptr, PyObject *pptr)
 {
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_remove() called: " << cptr << " -> " << pptr << endl;
-#endif
+    PYCLOPS_PROBE2(hash_table_remove, cptr, pptr);
 
     if (!cptr || !pptr)
 	throw runtime_error("pyclops: internal error: null pointer in master_hash_table_remove()");
@@ -60,29 +51,18 @@ void master_hash_table_remove(const void *cptr, PyObject *pptr)
 	throw runtime_error("pyclops: internal error in master_hash_table_remove(): PyObject mismatch");
 
     master_hash_table.erase(p);
-
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_remove(): success.  Current hash table follows." << endl;
-    master_hash_table_print();
-#endif
 }
 
 
 PyObject *master_hash_table_query(const void *cptr)
 {
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_query() called: " << cptr << endl;
-#endif
-
     if (!cptr)
 	throw runtime_error("pyclops: internal error: null pointer in master_hash_table_query()");
 
     auto p = master_hash_table.find(cptr);
     PyObject *ret = (p != master_hash_table.end()) ? p->second : NULL;
 
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_query() returning " << ret << endl;
-#endif
+    PYCLOPS_PROBE2(hash_table_query, cptr, ret);
 
     return ret;
 }
@@ -90,10 +70,6 @@ PyObject *master_hash_table_query(const void *cptr)
 
 void master_hash_table_deleter(const void *cptr)
 {
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_deleter() called: " << cptr << endl;
-#endif
-
     if (!cptr)
 	throw runtime_error("pyclops: internal error: null pointer in master_hash_table_deleter()");
 
@@ -110,9 +86,7 @@ void master_hash_table_deleter(const void *cptr)
 	op = p->second;
     } while (0);
 
-#if PYCLOPS_MASTER_HASH_TABLE_DEBUG
-    cout << "master_hash_table_deleter() found " << op << " , calling PyDECREF()" << endl;
-#endif
+    PYCLOPS_PROBE2(hash_table_deleter, cptr, op);
 
     Py_XDECREF(op);
 }
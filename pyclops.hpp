@@ -11,11 +11,25 @@
 #include "pyclops/py_type.hpp"
 #include "pyclops/py_weakref.hpp"
 
+#include "pyclops/intrusive_ptr.hpp"
 #include "pyclops/converters.hpp"
+#include "pyclops/record.hpp"
 #include "pyclops/array_converters.hpp"
 #include "pyclops/extension_type.hpp"
+#include "pyclops/type_registry.hpp"
+#include "pyclops/type_stats.hpp"
+#include "pyclops/soa_array.hpp"
 #include "pyclops/extension_module.hpp"
 #include "pyclops/functional_wrappers.hpp"
+#include "pyclops/function_converters.hpp"
+#include "pyclops/capi.hpp"
+#include "pyclops/call_stats.hpp"
+#include "pyclops/gil_stats.hpp"
+#include "pyclops/generator.hpp"
+#include "pyclops/threaded_generator.hpp"
+#include "pyclops/thread_pool.hpp"
+#include "pyclops/future.hpp"
+#include "pyclops/completion_queue.hpp"
 #include "pyclops/virtual_function.hpp"
 
 #endif  // _PYCLOPS_HPP
@@ -15,9 +15,13 @@
 #ifndef _PYCLOPS_ARRAY_CONVERTERS_HPP
 #define _PYCLOPS_ARRAY_CONVERTERS_HPP
 
+#include <vector>
+#include <cstring>
+
 #include "core.hpp"
 #include "py_array.hpp"
 #include "converters.hpp"
+#include "record.hpp"
 
 
 namespace pyclops {
@@ -110,6 +114,29 @@ struct io_ncarray : io_narray<T,N>
 };
 
 
+// -------------------------------------------------------------------------------------------------
+//
+// real_part(), imag_part(): zero-copy views of the real and imaginary parts of a complex array.
+//
+// Given a complex array 'a' (in_array<std::complex<T>> or io_array<std::complex<T>>, or any of
+// their subclasses), these return an in_array<T> or io_array<T> with the same shape, which aliases
+// the real (or imaginary) part of each element.  The strides are the strides of 'a' (in bytes), so
+// the element stride is always a multiple of 2, e.g. for a contiguous 1-d array:
+//
+//   io_array<float> re = real_part(a);
+//   npy_intp s = re.stride(0) / sizeof(float);   // s == 2
+//   for (npy_intp i = 0; i < re.size(); i++)
+//       re.data[i*s] *= 2.0;
+//
+// The views hold a reference to 'a', and are also valid numpy arrays which can be returned to python.
+
+
+template<typename T> inline in_array<T> real_part(const in_array<std::complex<T>> &a, const char *where=nullptr);
+template<typename T> inline in_array<T> imag_part(const in_array<std::complex<T>> &a, const char *where=nullptr);
+template<typename T> inline io_array<T> real_part(const io_array<std::complex<T>> &a, const char *where=nullptr);
+template<typename T> inline io_array<T> imag_part(const io_array<std::complex<T>> &a, const char *where=nullptr);
+
+
 // -------------------------------------------------------------------------------------------------
 //
 // Implementation follows.  Lots of things to improve here!
@@ -135,7 +162,7 @@ in_array<T>::in_array(const py_array &arr, const char *where) :
     py_array(arr),
     data(reinterpret_cast<const T *> (arr.data()))
 {
-    if (this->type() != npy_type<T>::id)
+    if (!npy_dtype<T>::matches(*this))
 	throw std::runtime_error(std::string(where ? where : "pyclops") + ": unexpected array dtype");
 }
 
@@ -172,7 +199,7 @@ struct converter<in_array<T>>
 {
     static in_array<T> from_python(const py_object &x, const char *where=nullptr) 
     {
-	return py_array::from_sequence(x, npy_type<T>::id, in_array<T>::default_flags);
+	return py_array::from_sequence(x, npy_dtype<T>::make(), in_array<T>::default_flags);
     }
 
     // No real reason to define a to-python converter, but why not?
@@ -185,7 +212,7 @@ struct converter<in_carray<T>>
 {
     static in_carray<T> from_python(const py_object &x, const char *where=nullptr) 
     {
-	return py_array::from_sequence(x, npy_type<T>::id, in_array<T>::default_flags | NPY_ARRAY_C_CONTIGUOUS);
+	return py_array::from_sequence(x, npy_dtype<T>::make(), in_array<T>::default_flags | NPY_ARRAY_C_CONTIGUOUS);
     }
 
     static py_object to_python(const in_array<T> &x) { return x; }
@@ -197,7 +224,7 @@ struct converter<in_narray<T,N>>
 {
     static in_narray<T,N> from_python(const py_object &x, const char *where=nullptr) 
     {
-	return py_array::from_sequence(x, npy_type<T>::id, in_array<T>::default_flags, N, N);
+	return py_array::from_sequence(x, npy_dtype<T>::make(), in_array<T>::default_flags, N, N);
     }
 
     static py_object to_python(const in_array<T> &x) { return x; }
@@ -213,13 +240,13 @@ struct converter<in_ncarray<T,N,C>>
 	if (C >= N)
 	    flags |= NPY_ARRAY_C_CONTIGUOUS;
 
-	py_array ret = py_array::from_sequence(x, npy_type<T>::id, flags, N, N);
+	py_array ret = py_array::from_sequence(x, npy_dtype<T>::make(), flags, N, N);
 	
 	if ((C >= N) || (ret.ncontig() >= C))
 	    return ret;
 
 	flags |= NPY_ARRAY_C_CONTIGUOUS;
-	return py_array::from_sequence(ret, npy_type<T>::id, flags);
+	return py_array::from_sequence(ret, npy_dtype<T>::make(), flags);
     }
 
     static py_object to_python(const in_array<T> &x) { return x; }
@@ -234,7 +261,7 @@ io_array<T>::io_array(const py_array &arr, const char *where) :
     py_array(arr),
     data(reinterpret_cast<T *> (arr.data()))
 {
-    if (this->type() != npy_type<T>::id)
+    if (!npy_dtype<T>::matches(*this))
 	throw std::runtime_error(std::string(where ? where : "pyclops") + ": unexpected array dtype");
     if ((this->flags() & NPY_ARRAY_WRITEABLE) != NPY_ARRAY_WRITEABLE)
 	throw std::runtime_error(std::string(where ? where : "pyclops") + ": io_array is not writeable");
@@ -273,7 +300,7 @@ struct converter<io_array<T>>
 {
     static io_array<T> from_python(const py_object &x, const char *where=nullptr) 
     {
-	return py_array::from_sequence(x, npy_type<T>::id, io_array<T>::default_flags);
+	return py_array::from_sequence(x, npy_dtype<T>::make(), io_array<T>::default_flags);
     }
 
     static py_object to_python(const io_array<T> &x) { return x; }
@@ -285,7 +312,7 @@ struct converter<io_carray<T>>
 {
     static io_carray<T> from_python(const py_object &x, const char *where=nullptr) 
     {
-	return py_array::from_sequence(x, npy_type<T>::id, io_array<T>::default_flags | NPY_ARRAY_C_CONTIGUOUS);
+	return py_array::from_sequence(x, npy_dtype<T>::make(), io_array<T>::default_flags | NPY_ARRAY_C_CONTIGUOUS);
     }
 
     static py_object to_python(const io_array<T> &x) { return x; }
@@ -297,7 +324,7 @@ struct converter<io_narray<T,N>>
 {
     static io_narray<T,N> from_python(const py_object &x, const char *where=nullptr) 
     {
-	return py_array::from_sequence(x, npy_type<T>::id, io_array<T>::default_flags, N, N);
+	return py_array::from_sequence(x, npy_dtype<T>::make(), io_array<T>::default_flags, N, N);
     }
 
     static py_object to_python(const io_array<T> &x) { return x; }
@@ -313,19 +340,189 @@ struct converter<io_ncarray<T,N,C>>
 	if (C >= N)
 	    flags |= NPY_ARRAY_C_CONTIGUOUS;
 
-	py_array ret = py_array::from_sequence(x, npy_type<T>::id, flags, N, N);
+	py_array ret = py_array::from_sequence(x, npy_dtype<T>::make(), flags, N, N);
 	
 	if ((C >= N) || (ret.ncontig() >= C))
 	    return ret;
 
 	flags |= NPY_ARRAY_C_CONTIGUOUS;
-	return py_array::from_sequence(ret, npy_type<T>::id, flags);
+	return py_array::from_sequence(ret, npy_dtype<T>::make(), flags);
     }
 
     static py_object to_python(const io_array<T> &x) { return x; }
 };
 
 
+// -------------------------------------------------------------------------------------------------
+//
+// real_part(), imag_part()
+
+
+// Helper: returns a numpy array of type T which aliases the real part (offset=0) or the
+// imaginary part (offset=1) of complex array 'a'.
+template<typename T>
+inline py_array _complex_part(const py_array &a, const void *data, int offset, bool writeable)
+{
+    static_assert(sizeof(std::complex<T>) == 2*sizeof(T), "pyclops: unexpected memory layout for std::complex<T>");
+
+    int flags = NPY_ARRAY_ALIGNED | NPY_ARRAY_NOTSWAPPED;
+    if (writeable)
+	flags |= NPY_ARRAY_WRITEABLE;
+
+    T *p = reinterpret_cast<T *> (const_cast<void *> (data)) + offset;
+    return py_array::from_pointer(a.ndim(), a.shape(), a.strides(), sizeof(T), p, npy_type<T>::id, flags, a);
+}
+
+
+template<typename T> 
+inline in_array<T> real_part(const in_array<std::complex<T>> &a, const char *where)
+{
+    return in_array<T> (_complex_part<T> (a, a.data, 0, false), where);
+}
+
+template<typename T> 
+inline in_array<T> imag_part(const in_array<std::complex<T>> &a, const char *where)
+{
+    return in_array<T> (_complex_part<T> (a, a.data, 1, false), where);
+}
+
+template<typename T> 
+inline io_array<T> real_part(const io_array<std::complex<T>> &a, const char *where)
+{
+    return io_array<T> (_complex_part<T> (a, a.data, 0, true), where);
+}
+
+template<typename T> 
+inline io_array<T> imag_part(const io_array<std::complex<T>> &a, const char *where)
+{
+    return io_array<T> (_complex_part<T> (a, a.data, 1, true), where);
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// std::vector<T> converter, for element types T with a numpy typenum (arithmetic and complex types).
+// The python object is a 1-d ndarray, and the data is copied with a single memcpy().  (The std::vector
+// converter for record types is in pyclops/record.hpp.)
+//
+// The assign_from_python() hook (see pyclops/converters.hpp) resizes the destination vector in place,
+// so a read-write property of type std::vector<T> reuses its existing capacity.  If the source is
+// already a conforming ndarray (aligned, contiguous, correct dtype), no intermediate copy is made.
+//
+// Lossy conversions raise an exception, for consistency with the scalar converters: integer -> integer
+// conversions which are not "safe" in the numpy sense (e.g. int64 -> int8) are range-checked element by
+// element, and other conversions must satisfy numpy's "same_kind" casting rule (so e.g. float -> int and
+// complex -> float are rejected).  Narrowing floating-point conversions (e.g. float64 -> float32) are
+// allowed, as in the scalar converters.
+
+
+template<typename T>
+struct _npy_vector_element : std::integral_constant<bool,
+    (std::is_integral<T>::value && !std::is_same<T,bool>::value && !std::is_same<T,wchar_t>::value
+     && !std::is_same<T,char16_t>::value && !std::is_same<T,char32_t>::value)
+    || std::is_floating_point<T>::value
+    || std::is_same<T, std::complex<float>>::value
+    || std::is_same<T, std::complex<double>>::value
+    || std::is_same<T, std::complex<long double>>::value>
+{ };
+
+
+// Helper for assign_from_python() below: range-checked narrowing integer conversion.  The source
+// array is read as S (long long or unsigned long long, which 'src' can be safely cast to), and 'dst'
+// is only modified if all elements are in range.
+template<typename T, typename S>
+inline void _npy_vector_assign_range_checked(std::vector<T> &dst, const py_array &src, const char *where)
+{
+    int flags = NPY_ARRAY_NOTSWAPPED | NPY_ARRAY_ALIGNED | NPY_ARRAY_C_CONTIGUOUS;
+    py_array a = py_array::from_sequence(src, npy_type<S>::id, flags, 1, 1);
+
+    npy_intp n = a.shape(0);
+    const S *p = reinterpret_cast<const S *> (a.data());
+
+    for (npy_intp i = 0; i < n; i++)
+	_integral_range_checked<T> (p[i], where);
+
+    dst.resize(n);
+
+    for (npy_intp i = 0; i < n; i++)
+	dst[i] = static_cast<T> (p[i]);
+}
+
+
+template<typename T>
+struct predicated_converter<std::vector<T>, typename std::enable_if<_npy_vector_element<T>::value>::type>
+{
+    static inline std::vector<T> from_python(const py_object &x, const char *where=nullptr)
+    {
+	std::vector<T> ret;
+	assign_from_python(ret, x, where);
+	return ret;
+    }
+
+    static inline void assign_from_python(std::vector<T> &dst, const py_object &x, const char *where=nullptr)
+    {
+	// First convert to an ndarray with its natural dtype (no-op if 'x' is already an ndarray),
+	// so that we can check the cast before doing it.
+	py_array src = py_array::from_sequence(x, (PyArray_Descr *) nullptr, 0, 1, 1);
+	py_object dtype = py_object::new_reference((PyObject *) PyArray_DescrFromType(npy_type<T>::id));
+	PyArrayObject *s = (PyArrayObject *) src.ptr;
+	PyArray_Descr *d = (PyArray_Descr *) dtype.ptr;
+
+	// An empty list has natural dtype float64, but converts to any vector.
+	if (src.size() == 0) {
+	    dst.clear();
+	    return;
+	}
+
+	if (!PyArray_CanCastArrayTo(s, d, NPY_SAFE_CASTING)) {
+	    if (_narrow_integral(dst, src, where))
+		return;
+
+	    if (!PyArray_CanCastArrayTo(s, d, NPY_SAME_KIND_CASTING))
+		throw std::runtime_error(std::string(where ? where : "pyclops") + ": can't convert array of type "
+					 + npy_typestr(PyArray_TYPE(s)) + " to std::vector<" + npy_typestr(npy_type<T>::id) + "> without loss");
+	}
+
+	// The cast has been checked above, so it's OK to force it (e.g. float64 -> float32).
+	int flags = NPY_ARRAY_NOTSWAPPED | NPY_ARRAY_ALIGNED | NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_FORCECAST;
+	py_array a = py_array::from_sequence(src, npy_type<T>::id, flags, 1, 1);
+
+	npy_intp n = a.shape(0);
+	dst.resize(n);
+
+	if (n > 0)
+	    memcpy(&dst[0], a.data(), n * sizeof(T));
+    }
+
+    // Range-checked integer -> integer conversion.  Returns false (and does nothing) unless both the
+    // source array and T are integral.
+    template<typename U = T, typename std::enable_if<std::is_integral<U>::value,int>::type = 0>
+    static inline bool _narrow_integral(std::vector<T> &dst, const py_array &src, const char *where)
+    {
+	if (!PyArray_ISINTEGER((PyArrayObject *) src.ptr))
+	    return false;
+	if (PyArray_ISUNSIGNED((PyArrayObject *) src.ptr))
+	    _npy_vector_assign_range_checked<T, unsigned long long> (dst, src, where);
+	else
+	    _npy_vector_assign_range_checked<T, long long> (dst, src, where);
+	return true;
+    }
+
+    template<typename U = T, typename std::enable_if<!std::is_integral<U>::value,int>::type = 0>
+    static inline bool _narrow_integral(std::vector<T> &, const py_array &, const char *) { return false; }
+
+    static inline py_object to_python(const std::vector<T> &x)
+    {
+	npy_intp n = x.size();
+	py_array ret = py_array::make(1, &n, npy_type<T>::id);
+
+	if (n > 0)
+	    memcpy(ret.data(), &x[0], n * sizeof(T));
+	return ret;
+    }
+};
+
+
 }  // namespace pyclops
 
 #endif  // _PYCLOPS_ARRAY_CONVERTERS_HPP
@@ -0,0 +1,153 @@
+#ifndef _PYCLOPS_CALL_STATS_HPP
+#define _PYCLOPS_CALL_STATS_HPP
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+#include "core.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Per-function call statistics, collected by the cfunction_table trampolines (see cfunction_table.cpp)
+// for functions registered with extension_module::add_function(), and methods/constructors registered
+// with extension_type::add_method(), add_staticmethod() and add_constructor().
+//
+// Collection is off by default (the cost is then one branch per call), and can be switched on at
+// runtime, or at startup by setting the environment variable PYCLOPS_CALL_STATS=1.  To expose to python:
+//
+//   m.add_function("enable_call_stats", "turn call statistics on/off", wrap_func(enable_call_stats, "on"));
+//   m.add_function("call_stats", "returns call statistics as a dict", wrap_func(get_call_stats));
+//   m.add_function("reset_call_stats", "zeroes call statistics", wrap_func(reset_call_stats));
+//
+//   # python
+//   m.enable_call_stats(True)
+//   ...
+//   s = m.call_stats()['fit']    # { 'ncalls': 100, 'nerrors': 0, 'total_ns': ..., 'max_ns': ...,
+//                                #   'convert_ns': ..., 'body_ns': ..., 'to_python_ns': ...,
+//                                #   'convert': [ ... ], 'body': [ ... ], 'to_python': [ ... ] }
+//
+// Keys are the names registered in add_function(), or "TypeName.method_name" for methods (so that
+// methods of different types don't collide), or "TypeName.__init__" for constructors.
+//
+// The time for each call is split into three phases: conversion of the arguments from python (including
+// argument checking), the C++ body, and conversion of the return value to python.  The phases are
+// separated by markers in wrap_func(), wrap_method() and wrap_constructor(); if a function wasn't created
+// by one of these, the whole call is counted as 'body'.  For each phase, the list (e.g. 'convert') is a
+// log2-bucketed latency histogram: element i is the number of calls whose phase took [2^i, 2^(i+1))
+// nanoseconds (element 0 also counts calls which took < 1 ns, and the last element is open-ended).
+//
+// Stats are kept per process (shared by all modules linked against libpyclops), and updated with
+// the GIL held.  If a wrapped function calls back into python (e.g. through a virtual_function
+// upcall) which calls another wrapped function, the time is counted in both functions.  Functions
+// with the same name (e.g. two modules with a function 'f') are merged.
+
+
+struct call_stats {
+    static constexpr int nphases = 3;      // convert, body, to_python
+    static constexpr int nbuckets = 40;    // up to 2^40 ns (~18 minutes)
+
+    const std::string name;
+
+    int64_t ncalls = 0;
+    int64_t nerrors = 0;
+    int64_t total_ns = 0;
+    int64_t max_ns = 0;
+    int64_t phase_ns[nphases];
+    int64_t histogram[nphases][nbuckets];
+
+    call_stats(const std::string &name);
+
+    void add(const int64_t *dt, bool error);   // dt = per-phase times (length nphases)
+    void reset();
+};
+
+
+// Returns the call_stats with the given name, creating and registering it (never deleted) if needed.
+// Called by make_kwargs_cfunction() etc.
+extern call_stats *make_call_stats(const std::string &name);
+
+// Can be wrapped with wrap_func() as shown above.
+extern void enable_call_stats(bool on);
+extern py_dict get_call_stats();
+extern void reset_call_stats();
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+// Helpers shared with pyclops/gil_stats.hpp.
+
+// Bucket i of a log2 histogram is [2^i, 2^(i+1)) ns (bucket 0 also counts dt <= 0, and the last bucket is open-ended).
+inline int _log2_bucket(int64_t dt, int nbuckets)
+{
+    int b = (dt > 0) ? (63 - __builtin_clzll(dt)) : 0;
+    return (b < nbuckets) ? b : (nbuckets-1);
+}
+
+// Returns a python list of length 'nbuckets'.
+extern py_object _histogram_to_python(const int64_t *h, int nbuckets, const char *where);
+
+// Returns true if environment variable 'name' is set to a nonzero integer.
+extern bool _getenv_flag(const char *name);
+
+
+extern bool _call_stats_enabled;
+
+// Phase boundaries in the current call (-1 if not reached), set by _call_stats_mark().
+extern thread_local int64_t _call_stats_marks[2];
+
+
+inline int64_t _call_stats_now()
+{
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (t).count();
+}
+
+// Marks the end of phase i (0 = argument conversion, 1 = C++ body).
+inline void _call_stats_mark(int i)
+{
+    if (_call_stats_enabled)
+	_call_stats_marks[i] = _call_stats_now();
+}
+
+// Marks the end of the C++ body, and passes its return value through to the to_python converter.
+template<typename T>
+inline T &&_call_stats_mark_body(T &&x)
+{
+    _call_stats_mark(1);
+    return std::forward<T> (x);
+}
+
+
+// Times one call, in the trampolines in cfunction_table.cpp.  Marks from the enclosing call
+// (if any) are saved and restored.
+struct _call_stats_timer {
+    call_stats *stats;
+    int64_t t0;
+    int64_t saved_marks[2];
+
+    _call_stats_timer(call_stats *stats_) :
+	stats(stats_)
+    {
+	saved_marks[0] = _call_stats_marks[0];
+	saved_marks[1] = _call_stats_marks[1];
+	_call_stats_marks[0] = _call_stats_marks[1] = -1;
+	t0 = _call_stats_now();
+    }
+
+    void stop(bool error);
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_CALL_STATS_HPP
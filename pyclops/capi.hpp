@@ -0,0 +1,130 @@
+#ifndef _PYCLOPS_CAPI_HPP
+#define _PYCLOPS_CAPI_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <typeinfo>
+#include <functional>
+
+#include "core.hpp"
+#include "cfunction_table.hpp"
+#include "functional_wrappers.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// C API capsules: calling functions in another pyclops extension module, without going through python.
+//
+// When extension_module::finalize() is called, every function which was registered with
+// add_function(..., wrap_func(...)) is also published in a table of C++ function pointers, stored
+// in the module attribute '_C_API' (a PyCapsule named "<module_name>._C_API").  A second extension
+// module can then look up the function by name and C++ signature, and call it directly:
+//
+//   // In module 'stages':
+//   m.add_function("smooth", "smooth an array", wrap_func(smooth, "x", "width"));
+//
+//   // In another module (e.g. in its init function).  The 'stages' module is imported if necessary.
+//   static capi_function<py_array(py_array,int)> smooth;
+//   smooth = capi_function<py_array(py_array,int)> ("stages", "smooth");
+//   ...
+//   py_array y = smooth(x, 5);   // direct C++ call (no tuple/dict construction or argument conversion)
+//
+// The lookup throws an exception if the module was built against an incompatible version of the
+// pyclops C API, if the function is not found, or if its C++ signature is not exactly R(Ts...).
+// Signatures are compared by a hash of the mangled typeid name (and then by the name itself), so
+// both modules must be compiled with ABI-compatible compilers (the usual requirement for sharing
+// C++ types between shared libraries).
+//
+// If the wrapped function is a plain function pointer, then calls go through the function pointer,
+// otherwise through the original std::function.  In either case, the GIL is not released.
+
+
+static constexpr uint32_t capi_magic = 0x70796361;   // "pyca"
+static constexpr uint32_t capi_version = 1;          // incremented when the table layout changes
+
+
+struct capi_entry {
+    const char *name;
+    const char *signature;        // mangled name, i.e. typeid(R(Ts...)).name()
+    uint64_t signature_hash;      // capi_signature_hash(signature)
+    void (*c_func)();             // non-NULL if the wrapped function is a plain function pointer
+    _cpp_callable_base *cpp_func;
+};
+
+
+struct capi_table {
+    uint32_t magic;
+    uint32_t version;
+    const char *module_name;
+    ssize_t nfunctions;
+    const capi_entry *functions;
+};
+
+
+// FNV-1a hash of the signature string (stable across compilers and processes, unlike std::hash).
+extern uint64_t capi_signature_hash(const char *signature);
+
+
+template<typename F> class capi_function;
+
+template<typename R, typename... Ts>
+class capi_function<R(Ts...)> {
+public:
+    capi_function() { }
+    capi_function(const std::string &module_name, const std::string &func_name);
+
+    inline R operator()(Ts... args) const;
+    inline explicit operator bool() const { return c_func || cpp_func; }
+
+protected:
+    R (*c_func)(Ts...) = nullptr;
+    const std::function<R(Ts...)> *cpp_func = nullptr;
+};
+
+
+// Called by extension_module::finalize().
+extern void _capi_publish(PyObject *module, const std::string &module_name, const std::vector<std::pair<std::string, std::shared_ptr<_cpp_callable_base>>> &functions);
+
+// Called by capi_function constructor.  Imports the capsule, checks the version and signature,
+// and throws an exception on failure.  (The 'version' argument is the consumer's capi_version.)
+extern const capi_entry *_capi_lookup(const std::string &module_name, const std::string &func_name, const std::type_info &signature, uint32_t version);
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+template<typename R, typename... Ts>
+capi_function<R(Ts...)>::capi_function(const std::string &module_name, const std::string &func_name)
+{
+    const capi_entry *e = _capi_lookup(module_name, func_name, typeid(R(Ts...)), capi_version);
+
+    // Signature was checked in _capi_lookup().
+    c_func = reinterpret_cast<R (*)(Ts...)> (e->c_func);
+    cpp_func = &static_cast<_cpp_callable<R(Ts...)> *> (e->cpp_func)->f;
+}
+
+
+template<typename R, typename... Ts>
+inline R capi_function<R(Ts...)>::operator()(Ts... args) const
+{
+    if (c_func)
+	return c_func(std::forward<Ts>(args)...);
+    if (cpp_func)
+	return (*cpp_func)(std::forward<Ts>(args)...);
+
+    throw std::runtime_error("pyclops: empty capi_function was called");
+}
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_CAPI_HPP
@@ -1,7 +1,9 @@
 #ifndef _PYCLOPS_CFUNCTION_TABLE_HPP
 #define _PYCLOPS_CFUNCTION_TABLE_HPP
 
+#include <memory>
 #include <sstream>
+#include <typeinfo>
 #include <iostream>
 #include <functional>
 
@@ -18,10 +20,55 @@ namespace pyclops {
 //
 // There is currently a hardcoded limit on the number of functions which can be converted,
 // but this should be fixable with some hackery.  
+//
+// If 'name' is non-NULL, call statistics are kept under that name (see pyclops/call_stats.hpp).
+
+extern PyCFunction make_kwargs_cfunction(std::function<py_object(py_tuple,py_dict)> f, const char *name=NULL);
+extern PyCFunction make_kwargs_cmethod(std::function<py_object(py_object,py_tuple,py_dict)> f, const char *name=NULL);
+extern initproc make_kwargs_initproc(std::function<void(py_object, py_tuple, py_dict)> f, const char *name=NULL);
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// The std::functions returned by wrap_func() remember the original C++ callable, so that if a
+// pyclops-wrapped function is passed back to C++ as a std::function (see pyclops/function_converters.hpp),
+// the original can be called directly, without a round trip through python.
+
+
+// Type-erased C++ callable.  The subclass _cpp_callable<R(Ts...)> is in pyclops/functional_wrappers.hpp.
+struct _cpp_callable_base {
+    virtual ~_cpp_callable_base() { }
+    virtual const std::type_info &signature() const = 0;
+
+    // If the callable is a plain function pointer, returns it (cast to void (*)()), otherwise NULL.
+    virtual void (*c_function() const)() = 0;
+};
+
+
+// Returned by wrap_func().  The cfunction_table stores 'py_func' and 'cpp_func' separately, so the
+// extra layer of std::function is not paid on each python call.
+struct _wrapped_func {
+    std::function<py_object(py_tuple,py_dict)> py_func;
+    std::shared_ptr<_cpp_callable_base> cpp_func;
+
+    _wrapped_func(const std::function<py_object(py_tuple,py_dict)> &py_func_, const std::shared_ptr<_cpp_callable_base> &cpp_func_) :
+	py_func(py_func_), cpp_func(cpp_func_) { }
+
+    py_object operator()(py_tuple args, py_dict kwds) const { return py_func(std::move(args), std::move(kwds)); }
+};
+
+
+// For methods, the original C++ callable is recovered by binding it to 'self' (a PyObject which
+// has already been type-checked).  Returns an empty pointer if 'self' can't be bound.
+using _cpp_binder = std::function<std::shared_ptr<_cpp_callable_base> (PyObject *self)>;
+
+extern PyCFunction make_kwargs_cmethod(std::function<py_object(py_object,py_tuple,py_dict)> f, const _cpp_binder &bind, const char *name=NULL);
+
 
-extern PyCFunction make_kwargs_cfunction(std::function<py_object(py_tuple,py_dict)> f);
-extern PyCFunction make_kwargs_cmethod(std::function<py_object(py_object,py_tuple,py_dict)> f);
-extern initproc make_kwargs_initproc(std::function<void(py_object, py_tuple, py_dict)> f);
+// If 'x' is a builtin function (or bound method) which was created by make_kwargs_cfunction() or
+// make_kwargs_cmethod(), and the original C++ callable is known, returns it.  Otherwise returns
+// an empty pointer.
+extern std::shared_ptr<_cpp_callable_base> find_cpp_callable(PyObject *x);
 
 
 // -------------------------------------------------------------------------------------------------
@@ -0,0 +1,92 @@
+#ifndef _PYCLOPS_COMPLETION_QUEUE_HPP
+#define _PYCLOPS_COMPLETION_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "core.hpp"
+#include "converters.hpp"
+#include "future.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// completion_queue: delivers completed futures (see pyclops/future.hpp) to python through a Linux
+// eventfd, so that python can wait for many C++ operations with select/epoll, or an asyncio-style
+// event loop, instead of polling each future.
+//
+//   // C++: expose the python type (constructible from python).
+//   m.add_object("completion_queue", completion_queue_type());
+//
+//   # python
+//   cq = m.completion_queue()
+//   loop.add_reader(cq.fileno(), on_ready)
+//   for x in inputs:
+//       cq.watch(m.fit(x))          # m.fit() wrapped with wrap_func_async()
+//
+//   def on_ready():
+//       for f in cq.drain():        # completed futures, in completion order
+//           handle(f.result())      # already converted by drain(), so result() doesn't block
+//
+// Worker threads post completions without the GIL or a lock (a lock-free stack), and write to the
+// eventfd only when the queue goes from empty to non-empty, so a burst of completions wakes python
+// once.  drain() then converts all completed results to python in a single pass with the GIL held.
+// (A future whose C++ call threw an exception is returned as-is, and result() raises the exception.)
+//
+// C++ code can also post its own completions: create a future with make_future_state() and
+// make_python_future(), return the python future (or watch() it), and call set_result() from any thread.
+
+
+class completion_queue {
+public:
+    completion_queue();    // creates the eventfd (nonblocking, close-on-exec)
+    ~completion_queue();   // closes the eventfd
+
+    completion_queue(const completion_queue &) = delete;
+    completion_queue &operator=(const completion_queue &) = delete;
+
+    int fileno() const { return fd; }
+
+    // Thread-safe and lock-free, and may be called without the GIL.
+    void post(const std::shared_ptr<future_state> &s);
+
+    // Called with the GIL held.  Returns all posted futures (in the order they were posted), and
+    // resets the eventfd.
+    std::vector<std::shared_ptr<future_state>> drain();
+
+protected:
+    struct node {
+	std::shared_ptr<future_state> state;
+	node *next;
+    };
+
+    std::atomic<node *> head;   // most recently posted
+    int fd = -1;                // read end (python waits on this)
+    int wfd = -1;               // write end (same as 'fd' for an eventfd, or a pipe on non-Linux)
+};
+
+
+// Returns the python type object pyclops.completion_queue.
+extern py_object completion_queue_type();
+
+// Python completion_queue objects hold a shared_ptr<completion_queue>.
+extern std::shared_ptr<completion_queue> completion_queue_from_python(const py_object &x, const char *where=NULL);
+extern py_object completion_queue_to_python(const std::shared_ptr<completion_queue> &q);
+
+
+template<>
+struct converter<std::shared_ptr<completion_queue>> {
+    static std::shared_ptr<completion_queue> from_python(const py_object &x, const char *where=NULL) { return completion_queue_from_python(x, where); }
+    static py_object to_python(const std::shared_ptr<completion_queue> &q) { return completion_queue_to_python(q); }
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_COMPLETION_QUEUE_HPP
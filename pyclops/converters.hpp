@@ -2,6 +2,8 @@
 #define _PYCLOPS_FROM_PYTHON_HPP
 
 #include <vector>
+#include <limits>
+#include <complex>
 
 #include "core.hpp"
 #include "py_array.hpp"
@@ -21,6 +23,18 @@ namespace pyclops {
 //      static inline py_object to_python(const T & x);
 //   };
 //
+// Optionally, a converter can also define 'static inline py_object to_python(T &&x)', which
+// will be used for temporaries (e.g. return values of wrapped functions), to avoid a copy.
+//
+// Optionally, a converter can also define
+//
+//      static inline void assign_from_python(T &dst, const py_object &x, const char *where=nullptr);
+//
+// which writes directly into existing storage (e.g. a std::vector which is resized in place,
+// reusing its capacity), instead of constructing a temporary T and assigning it.  This is used
+// by read-write properties (see extension_type::add_property()).  Callers should use the
+// free function assign_from_python() below, which falls back to from_python() if needed.
+//
 // It is also useful to define "predicated" converters which apply to all types T which
 // satisfy a boolean condition.  For example, a converter which applies to all integral
 // types.  This can be done with the following awkward and not-very-intuitive boilerplate:
@@ -46,11 +60,35 @@ template<typename T>
 struct converts_from_python<T, decltype(converter<T>::from_python(std::declval<py_object>()))> : std::true_type { };
 
 
+// Note: converts_to_python<T> tests whether an rvalue of type T (e.g. a function return value) can be
+// converted.  Converters may define to_python(T &&) in addition to (or instead of) to_python(const T &).
+
 template<typename T, typename = py_object>
 struct converts_to_python : std::false_type { };
 
 template<typename T>
-struct converts_to_python<T, decltype(converter<T>::to_python(std::declval<const T>()))> : std::true_type { };
+struct converts_to_python<T, decltype(converter<T>::to_python(std::declval<T>()))> : std::true_type { };
+
+
+template<typename T, typename = void>
+struct has_assign_from_python : std::false_type { };
+
+template<typename T>
+struct has_assign_from_python<T, decltype(converter<T>::assign_from_python(std::declval<T &>(), std::declval<py_object>()))> : std::true_type { };
+
+
+// assign_from_python(dst, x): uses the converter's assign_from_python() if defined, else from_python().
+template<typename T, typename std::enable_if<has_assign_from_python<T>::value,int>::type = 0>
+inline void assign_from_python(T &dst, const py_object &x, const char *where=nullptr)
+{
+    converter<T>::assign_from_python(dst, x, where);
+}
+
+template<typename T, typename std::enable_if<!has_assign_from_python<T>::value,int>::type = 0>
+inline void assign_from_python(T &dst, const py_object &x, const char *where=nullptr)
+{
+    dst = converter<T>::from_python(x, where);
+}
 
 
 // -------------------------------------------------------------------------------------------------
@@ -80,19 +118,101 @@ template<> struct converter<py_object> {
 // Some fundamental types (integers, floating-point, strings, etc.)
 
 
+// _integral_in_range<T>(n): returns true if integer 'n' (of any integral type) is representable as type T.
+// We compare in a way which is correct for mixed signedness, so that (for example) a negative
+// numpy.int64 is rejected when converting to 'unsigned int', and 70000 is rejected for 'int16_t'.
+
+template<typename T, typename I>
+inline bool _integral_in_range(I n)
+{
+    static_assert(std::is_integral<T>::value && std::is_integral<I>::value, "pyclops internal error: _integral_in_range() called with non-integral type");
+
+    if (std::is_signed<I>::value && (n < I(0))) {
+	if (!std::is_signed<T>::value)
+	    return false;
+	return (long long)n >= (long long)std::numeric_limits<T>::min();
+    }
+
+    return (unsigned long long)n <= (unsigned long long)std::numeric_limits<T>::max();
+}
+
+
+template<typename T, typename I>
+inline T _integral_range_checked(I n, const char *where)
+{
+    if (!_integral_in_range<T>(n))
+	throw std::runtime_error(std::string(where ? where : "pyclops") + ": integer value out of range for C++ type");
+    return static_cast<T> (n);
+}
+
+
+// _from_npy_integer_scalar(): helper for the integral converter.
+// If 'p' is a numpy integer scalar (e.g. numpy.int64 obtained by indexing an array), then its value
+// is read directly from the scalar object with the exact C type, and we return true.  This avoids
+// going through the generic number protocol, which allocates intermediate python objects.
+// Returns false if 'p' is not a numpy integer scalar.
+//
+// Note: PyArray_IsScalar() is a subclass check, so we test the most common types first.
+
+template<typename T>
+inline bool _from_npy_integer_scalar(PyObject *p, T &ret, const char *where)
+{
+    if (!PyArray_IsScalar(p, Integer))
+	return false;
+
+    if (PyArray_IsScalar(p, Long))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, Long), where);
+    else if (PyArray_IsScalar(p, Int))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, Int), where);
+    else if (PyArray_IsScalar(p, LongLong))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, LongLong), where);
+    else if (PyArray_IsScalar(p, Short))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, Short), where);
+    else if (PyArray_IsScalar(p, Byte))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, Byte), where);
+    else if (PyArray_IsScalar(p, ULong))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, ULong), where);
+    else if (PyArray_IsScalar(p, UInt))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, UInt), where);
+    else if (PyArray_IsScalar(p, ULongLong))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, ULongLong), where);
+    else if (PyArray_IsScalar(p, UShort))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, UShort), where);
+    else if (PyArray_IsScalar(p, UByte))
+	ret = _integral_range_checked<T> (PyArrayScalar_VAL(p, UByte), where);
+    else
+	return false;
+
+    return true;
+}
+
+
 // predicated_converter for integral types, except 'bool' which is a special case below.
 // FIXME should also have special case for char (to convert from python length-1 string)?
-// FIXME incorporate climits here.
+//
+// The from_python converter has two fast paths: an exact python int (PyInt_AS_LONG() without
+// error checking), and numpy integer scalars (see _from_npy_integer_scalar() above).  Everything
+// else goes through PyInt_AsSsize_t().  In all cases, the value is range-checked against T.
+//
+// Note: in python 2, numpy.int64 is a subclass of 'int', so we use PyInt_CheckExact() rather
+// than PyInt_Check() here, in order to send numpy scalars down the second fast path.
 
 template<typename T>
 struct predicated_converter<T, typename std::enable_if<std::is_integral<T>::value>::type>
 {
     static inline T from_python(const py_object &x, const char *where=nullptr)
     {
+	if (PyInt_CheckExact(x.ptr))
+	    return _integral_range_checked<T> (PyInt_AS_LONG(x.ptr), where);
+
+	T ret;
+	if (_from_npy_integer_scalar(x.ptr, ret, where))
+	    return ret;
+
 	ssize_t n = PyInt_AsSsize_t(x.ptr);
 	if ((n == -1) && PyErr_Occurred())
 	    throw pyerr_occurred(where);
-	return n;
+	return _integral_range_checked<T> (n, where);
     }
 
     static inline py_object to_python(const T &x) 
@@ -104,12 +224,14 @@ struct predicated_converter<T, typename std::enable_if<std::is_integral<T>::valu
 
 // bool converter.
 // By default the bool from-python converter is "strict", i.e. it expects either True or False.
+// Numpy booleans (numpy.bool_, e.g. obtained by indexing a boolean array) are also accepted.
 // FIXME define "relaxed_bool", which evaluates its argument to True/False.
 template<> struct converter<bool> {
     static bool from_python(const py_object &x, const char *where=nullptr)
     {
 	if (x.ptr == Py_True) return true;
 	if (x.ptr == Py_False) return false;
+	if (PyArray_IsScalar(x.ptr, Bool)) return PyArrayScalar_VAL(x.ptr, Bool) != 0;
 	throw std::runtime_error(std::string(where ? where : "pyclops") + ": expected True or False");
     }
 
@@ -121,11 +243,25 @@ template<> struct converter<bool> {
 
 
 // predicated_converter for floating-point types
+//
+// As with the integral converter, there are fast paths for an exact python float and for numpy
+// floating-point scalars (numpy.float32, numpy.float64, numpy.longdouble), which are read directly
+// with the exact C type.  Everything else goes through PyFloat_AsDouble().
+
 template<typename T>
 struct predicated_converter<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
 {
     static inline T from_python(const py_object &x, const char *where=nullptr)
     {
+	if (PyFloat_CheckExact(x.ptr))
+	    return PyFloat_AS_DOUBLE(x.ptr);
+	if (PyArray_IsScalar(x.ptr, Double))
+	    return PyArrayScalar_VAL(x.ptr, Double);
+	if (PyArray_IsScalar(x.ptr, Float))
+	    return PyArrayScalar_VAL(x.ptr, Float);
+	if (PyArray_IsScalar(x.ptr, LongDouble))
+	    return PyArrayScalar_VAL(x.ptr, LongDouble);
+
 	double ret = PyFloat_AsDouble(x.ptr);
 	if ((ret == -1.0) && PyErr_Occurred())
 	    throw pyerr_occurred(where);
@@ -139,6 +275,52 @@ struct predicated_converter<T, typename std::enable_if<std::is_floating_point<T>
 };
 
 
+// converter for std::complex<T>, where T is a floating-point type.
+//
+// There are fast paths for an exact python complex and for numpy complex scalars (numpy.complex64,
+// numpy.complex128, numpy.clongdouble), whose value is read directly with the exact C type.
+// Everything else (including python ints and floats) goes through PyComplex_AsCComplex().
+//
+// (The numpy scalar types and PyArrayScalar_VAL() are declared in <numpy/arrayscalars.h>, which is
+// included by pyclops/core.hpp.)
+
+template<typename T>
+struct converter<std::complex<T>>
+{
+    static_assert(std::is_floating_point<T>::value, "pyclops: converter<std::complex<T>> is only defined for floating-point T");
+
+    static inline std::complex<T> from_python(const py_object &x, const char *where=nullptr)
+    {
+	if (PyComplex_CheckExact(x.ptr)) {
+	    Py_complex c = reinterpret_cast<PyComplexObject *> (x.ptr)->cval;
+	    return std::complex<T> (c.real, c.imag);
+	}
+	if (PyArray_IsScalar(x.ptr, CDouble)) {
+	    npy_cdouble c = PyArrayScalar_VAL(x.ptr, CDouble);
+	    return std::complex<T> (c.real, c.imag);
+	}
+	if (PyArray_IsScalar(x.ptr, CFloat)) {
+	    npy_cfloat c = PyArrayScalar_VAL(x.ptr, CFloat);
+	    return std::complex<T> (c.real, c.imag);
+	}
+	if (PyArray_IsScalar(x.ptr, CLongDouble)) {
+	    npy_clongdouble c = PyArrayScalar_VAL(x.ptr, CLongDouble);
+	    return std::complex<T> (c.real, c.imag);
+	}
+
+	Py_complex c = PyComplex_AsCComplex(x.ptr);
+	if ((c.real == -1.0) && PyErr_Occurred())
+	    throw pyerr_occurred(where);
+	return std::complex<T> (c.real, c.imag);
+    }
+
+    static inline py_object to_python(const std::complex<T> &x)
+    {
+	return py_object::new_reference(PyComplex_FromDoubles(x.real(), x.imag()));
+    }
+};
+
+
 // string converter
 // FIXME: write a converter so that functions with (const char *) args are wrappable.
 template<> struct converter<std::string> {
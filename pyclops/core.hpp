@@ -5,6 +5,7 @@
 
 #include <Python.h>
 #include <numpy/arrayobject.h>
+#include <numpy/arrayscalars.h>
 
 #include <memory>
 #include <iostream>
@@ -182,6 +183,10 @@ struct pyerr_occurred : std::exception
     virtual char const *what() const noexcept;
 };
 
+// This is called whenever we want to "swallow" a C++ exception, but propagate it into the python error indicator.
+// (Defined in exceptions.cpp.)
+extern void set_python_error(const std::exception &e) noexcept;
+
 
 // -------------------------------------------------------------------------------------------------
 //
@@ -201,6 +206,18 @@ extern void master_hash_table_deleter(const void *p);
 extern void master_hash_table_print();
 
 
+// -------------------------------------------------------------------------------------------------
+//
+// Type objects.
+
+
+// Allocates a new PyTypeObject (never freed), and initializes its header, tp_name, tp_doc,
+// tp_basicsize, and tp_flags (to Py_TPFLAGS_DEFAULT).  The caller fills in the remaining slots,
+// and then calls PyType_Ready().  The 'name' and 'doc' strings are not copied.
+// (Defined in extension_module.cpp.)
+extern PyTypeObject *_make_static_type(const char *name, const char *doc, ssize_t basicsize);
+
+
 // -------------------------------------------------------------------------------------------------
 //
 // py_object implementation.
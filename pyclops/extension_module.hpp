@@ -3,10 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <functional>
 
 #include "core.hpp"
 #include "extension_type.hpp"
+#include "type_registry.hpp"
 
 namespace pyclops {
 #if 0
@@ -21,10 +23,17 @@ public:
     void add_function(const std::string &func_name, const std::string &func_docstring, std::function<py_object(py_tuple,py_dict)> func);
     void add_function(const std::string &func_name, std::function<py_object(py_tuple,py_dict)> func);   // empty docstring
 
+    // Also registers the type as "<module_name>.<type_name>", so that other modules can use it
+    // (see import_extension_type() in pyclops/type_registry.hpp).
     template<typename T, typename B>
     inline void add_type(extension_type<T,B> &type);
 
-    // Registers module with the python interpreter (by calling Py_InitModule3())
+    // Adds an arbitrary python object (e.g. completion_queue_type(), see pyclops/completion_queue.hpp)
+    // as a module attribute.
+    void add_object(const std::string &name, const py_object &obj);
+
+    // Registers module with the python interpreter (by calling Py_InitModule3()), and publishes
+    // functions wrapped with wrap_func() in the module's C API capsule (see pyclops/capi.hpp).
     void finalize();
 
 protected:
@@ -36,6 +45,11 @@ protected:
 
     std::vector<PyTypeObject *> module_types;
 
+    std::vector<std::pair<std::string, py_object>> module_objects;
+
+    // (name, original C++ callable) pairs, for the C API capsule.
+    std::vector<std::pair<std::string, std::shared_ptr<_cpp_callable_base>>> capi_functions;
+
     bool finalized = false;
 };
 
@@ -48,6 +62,11 @@ inline void extension_module::add_type(extension_type<T,B> &type)
 
     type.finalize();
     module_types.push_back(type.tobj);
+
+    std::string name = module_name + "." + type.tobj->tp_name;
+    type.stats->name = name;   // see pyclops/type_stats.hpp
+
+    _register_extension_type(name, typeid(T), typeid(B), static_cast<void *> (&type), type.tobj);
 }
 
 
@@ -2,10 +2,15 @@
 #define _PYCLOPS_EXTENSION_TYPE_HPP
 
 #include <memory>
+#include <cstring>
+#include <functional>
 #include "core.hpp"
 #include "converters.hpp"
+#include "array_converters.hpp"
+#include "intrusive_ptr.hpp"
 #include "cfunction_table.hpp"
 #include "functional_wrappers.hpp"
+#include "type_stats.hpp"
 
 namespace pyclops {
 #if 0
@@ -23,6 +28,10 @@ struct _extension_subtype {
     // Returns NULL if dynamic_pointer_cast fails (throws exception on miscellaneous failure).
     // Caller must check that 'x' is a nonempty pointer, and x.get() is not in the master_hash_table.
     virtual PyObject *_to_python(const std::shared_ptr<B> &x) = 0;
+
+    // Returns NULL if dynamic_cast fails.  If a python object is returned, it has taken ownership of 'x'.
+    // Caller must check that 'x' is non-NULL, and 'x' is not in the master_hash_table.
+    virtual PyObject *_adopt(B *x) = 0;
 };
 
 
@@ -34,143 +43,1334 @@ struct extension_type : _extension_subtype<B>
     using wrapped_type = T;
     using wrapped_base = B;
 
-    // Use this constructor if there is no python-wrapped base class (i.e. B == T).
-    inline extension_type(const std::string &name, const std::string &docstring);
+    // Use this constructor if there is no python-wrapped base class (i.e. B == T).
+    inline extension_type(const std::string &name, const std::string &docstring);
+
+    // Use this constructor if there is a python-wrapped base class (i.e. B != T).
+    // The constructor will check (via static_assert) that E::wrapped_type == B.
+    template<typename E>
+    inline extension_type(const std::string &name, const std::string &docstring, E &base);
+    
+    inline void add_constructor(std::function<T* (py_object,py_tuple,py_dict)> f);
+
+    // The 'f' argument will usually be obtained from wrap_method(), in pyclops/functional_wrappers.hpp.
+    inline void add_method(const std::string &name, const std::string &docstring, std::function<py_object(T *,py_tuple,py_dict)> f);
+
+    // The 'f' argument will usually be obtained from wrap_func(), in pyclops/functional_wrappers.hpp.
+    inline void add_staticmethod(const std::string &name, const std::string &docstring, std::function<py_object(py_tuple,py_dict)> f);
+
+    // General property API.
+    inline void add_property(const std::string &name, const std::string &docstring, const std::function<py_object(py_object)> &f_get);
+    inline void add_property(const std::string &name, const std::string &docstring, const std::function<py_object(py_object)> &f_get, const std::function<void(py_object,py_object)> &f_set);
+
+    // This more specific API suffices for simple properties.
+    //    struct X { int x; ... };
+    //    std::function<int(const X*)> f_ro = [](const X *self) { return self->x; };
+    //    std::function<int& (X*)> f_rw = [](X *self) -> int& { return self->x; };
+
+    template<typename R>
+    inline void add_property(const std::string &name, const std::string &docstring, const std::function<R(const T *)> &f);
+
+    template<typename R>
+    inline void add_property(const std::string &name, const std::string &docstring, const std::function<R& (T *)> &f);
+
+    // Sets the 'finalize' flag.
+    // Note: this is called automatically in extension_module::add_type().
+    //
+    // If T defines operator== or operator<, then finalize() also installs tp_richcompare, and tp_hash
+    // if std::hash<T> is defined (see _compare_slots<T> below).  Similarly, tp_as_number is populated
+    // from C++ arithmetic operators (see _number_slots<T> below), and tp_as_sequence/tp_as_mapping
+    // are populated from T::size() and T::operator[] (see _sequence_slots<T> below).  If T defines
+    // begin() and end(), then tp_iter is populated (see _iterator_slots<T> below).
+    inline void finalize();
+
+    // These guys are intended to be wrapped by converters.
+    // FIXME wouldn't it be better to make them member functions?
+    static inline T *bare_pointer_from_python(PyTypeObject *tobj, const py_object &obj, const char *where=nullptr);
+    static inline std::shared_ptr<T> shared_ptr_from_python(PyTypeObject *tobj, const py_object &obj, const char *where=nullptr);
+    static inline intrusive_ptr<T> intrusive_ptr_from_python(PyTypeObject *tobj, const py_object &obj, const char *where=nullptr);
+
+    // This version of to_python() is "the" to_python converter for the wrapped type T.
+    // It checks for an empty pointer, checks the master_hash_table, and checks all of the derived_types.
+    inline py_object to_python(const std::shared_ptr<T> &x);
+
+    // This version of to_python() transfers ownership of a unique_ptr to a new python-managed object
+    // (see class_wrapper<T> below).  There is no copy, and no shared_ptr control block is allocated.
+    // The unique_ptr is released only if the python object was successfully created.
+    inline py_object to_python(std::unique_ptr<T> &&x);
+
+    // This version of to_python() is only defined if T has an intrusive refcount (see pyclops/intrusive_ptr.hpp).
+    // If a new python object is created, it is python-managed, and holds its own count.
+    inline py_object to_python(const intrusive_ptr<T> &x);
+
+    static inline void tp_dealloc(PyObject *self);
+
+    // This version of _to_python() is called recursively via the base class.
+    // (See _extension_subtype above.)
+    inline PyObject *_to_python(const std::shared_ptr<B> &x) override;
+    inline PyObject *_adopt(B *x) override;
+
+    // Helper function called by constructors.
+    inline void _construct(const std::string &name, const std::string &docstring);
+
+    // Helper function called by to_python() and _to_python().
+    // Returns new reference; never returns NULL.
+    inline PyObject *_make(const std::shared_ptr<T> &p);
+
+    // Helper function called by to_python() and _adopt().
+    // Makes a python-managed object, which takes ownership of 'p' if no exception is thrown.
+    // (If T has an intrusive refcount, the python object takes one count instead.)
+    inline PyObject *_make(T *p);
+
+    // Allocated and initialized at construction.
+    PyTypeObject *tobj = nullptr;
+
+    // Note: bare pointer to std::vector is intentional here!
+    std::vector<PyMethodDef> *methods = nullptr;     // (name, cfunc, flags, docstring)
+    std::vector<PyGetSetDef> *getsetters = nullptr;  // (name, getter, setter, doc, closure)
+    bool finalized = false;                          // if true, no methods or getsetters may be added.
+    type_stats *stats = nullptr;                     // object counts (see pyclops/type_stats.hpp)
+
+    // Note: base_types have pointers to their derived_types, but not vice versa!
+    // Note: it's OK to add derived_types after the 'finalized' flag is set.
+    // This is because new derived types may be defined at any time (e.g. when another module is imported).
+    std::vector<_extension_subtype<T> *> derived_types;
+};
+
+
+// FIXME superseded by 'class virtual function', should it be removed?
+inline py_object _py_upcall(void *self, const char *meth_name, const py_tuple &args);
+
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// xconverter: used to define converters for extension_types.
+//
+// FIXME should this code be moved elsewhere?
+// FIXME 'xconverter' needs better name!
+//
+// FIXME has_xconverter could be improved (just checks that static member function 'type' exists and is a pointer)
+
+
+// expects 'static constexpr extension_type<T,B> *type = ...'
+template<typename T> struct xconverter;
+
+
+template<typename T, typename = void>
+struct has_xconverter : std::false_type { };
+
+template<typename T>
+struct has_xconverter<T, typename std::enable_if<std::is_pointer<decltype(xconverter<T>::type)>::value>::type> : std::true_type { };
+
+
+template<typename T>
+struct predicated_converter<T&, typename std::enable_if<has_xconverter<T>::value>::type>
+{
+    static inline T& from_python(const py_object &x, const char *where=nullptr)
+    {
+	auto p = extension_type<T>::shared_ptr_from_python(xconverter<T>::type->tobj, x, where);
+	return *p;
+    }
+};
+
+
+template<typename T>
+struct predicated_converter<std::shared_ptr<T>, typename std::enable_if<has_xconverter<T>::value>::type>
+{
+    static std::shared_ptr<T> from_python(const py_object &obj, const char *where=nullptr)
+    {
+	return extension_type<T>::shared_ptr_from_python(xconverter<T>::type->tobj, obj, where);
+    }
+	
+    static py_object to_python(const std::shared_ptr<T> &x)
+    {
+	return xconverter<T>::type->to_python(x);
+    }
+};
+
+
+// Note: we don't have a notion of "const" python objects, so shared_ptr<const T> is converted
+// to python by casting away the const.  This is the same python object as for shared_ptr<T>.
+
+template<typename T>
+struct predicated_converter<std::shared_ptr<const T>, typename std::enable_if<has_xconverter<T>::value>::type>
+{
+    static std::shared_ptr<const T> from_python(const py_object &obj, const char *where=nullptr)
+    {
+	return extension_type<T>::shared_ptr_from_python(xconverter<T>::type->tobj, obj, where);
+    }
+	
+    static py_object to_python(const std::shared_ptr<const T> &x)
+    {
+	return xconverter<T>::type->to_python(std::const_pointer_cast<T> (x));
+    }
+};
+
+
+template<typename T>
+struct predicated_converter<intrusive_ptr<T>, typename std::enable_if<has_xconverter<T>::value && has_intrusive_refcount<T>::value>::type>
+{
+    static intrusive_ptr<T> from_python(const py_object &obj, const char *where=nullptr)
+    {
+	return extension_type<T>::intrusive_ptr_from_python(xconverter<T>::type->tobj, obj, where);
+    }
+	
+    static py_object to_python(const intrusive_ptr<T> &x)
+    {
+	return xconverter<T>::type->to_python(x);
+    }
+};
+
+
+// unique_ptr<T> is to-python only.  The returned python object is python-managed (i.e. the
+// T object is deleted in tp_dealloc()), and C++ code can still get a shared_ptr<T> later via
+// the shared_ptr from_python converter.  There is no from_python converter, since a python
+// object can't give up ownership while other python references to it may exist.
+
+template<typename T>
+struct predicated_converter<std::unique_ptr<T>, typename std::enable_if<has_xconverter<T>::value>::type>
+{
+    static py_object to_python(std::unique_ptr<T> &&x)
+    {
+	return xconverter<T>::type->to_python(std::move(x));
+    }
+};
+
+
+// Helper for by-value to_python converters: constructs a new T from 'x', and wraps it in a new python object.
+// Usually the T is owned by a shared_ptr<T>.  If T has an intrusive refcount, the python object is
+// python-managed instead (as if constructed from python), so that it can be converted to intrusive_ptr<T>.
+
+template<typename T, typename X, typename std::enable_if<!has_intrusive_refcount<T>::value,int>::type = 0>
+inline py_object _to_python_new(X &&x)
+{
+    auto p = std::make_shared<T> (std::forward<X> (x));
+    return xconverter<T>::type->to_python(p);
+}
+
+template<typename T, typename X, typename std::enable_if<has_intrusive_refcount<T>::value,int>::type = 0>
+inline py_object _to_python_new(X &&x)
+{
+    return xconverter<T>::type->to_python(std::unique_ptr<T> (new T(std::forward<X> (x))));
+}
+
+
+// By-value to_python converter.  Temporaries (e.g. return values from wrapped functions) are moved into
+// the new object, so there is no copy.  The const T& version invokes the copy constructor, and is
+// disabled at compile time if T is not copy-constructible (so move-only types can be returned by value).
+
+template<typename T>
+struct predicated_converter<T, typename std::enable_if<has_xconverter<T>::value>::type>
+{
+    static inline py_object to_python(T &&x)
+    {
+	return _to_python_new<T> (std::move(x));
+    }
+
+    template<typename U = T, typename std::enable_if<std::is_copy_constructible<U>::value,int>::type = 0>
+    static inline py_object to_python(const T &x)
+    {
+	return _to_python_new<T> (x);
+    }
+};
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Return-value policies return_move and return_reference_internal (see pyclops/functional_wrappers.hpp).
+// These are only defined for extension types, so they are implemented here rather than in functional_wrappers.hpp.
+
+
+template<typename R>
+struct _rv_policy<return_move, R>
+{
+    using U = typename std::decay<R>::type;
+
+    static_assert(!std::is_lvalue_reference<R>::value, "return_move policy: can't move from an lvalue reference (use return_copy or return_reference_internal instead)");
+    static_assert(!std::is_pointer<U>::value, "return_move policy: return type must be a value or rvalue reference, not a pointer");
+    static_assert(std::is_move_constructible<U>::value, "return_move policy: return type must be move-constructible");
+
+    static constexpr bool valid = has_xconverter<U>::value;
+
+    template<typename C>
+    static inline py_object to_python(C *self, R &&x)
+    {
+	return _to_python_new<U> (std::move(x));
+    }
+};
+
+
+// Helper for return_reference_internal: returns python object which aliases 'member', and keeps 'self' alive.
+template<typename C, typename U>
+inline py_object _reference_internal(C *self, U *member)
+{
+    static_assert(has_xconverter<C>::value, "return_reference_internal policy: class of wrapped method must be an extension type");
+
+    if (!member)
+	return py_object();  // None
+
+    PyObject *sp = master_hash_table_query(self);
+    if (!sp)
+	throw std::runtime_error("pyclops: return_reference_internal: couldn't find 'self' in master_hash_table");
+
+    // If 'member' is at offset zero in 'self', then its address is the same as 'self', and the master_hash_table
+    // can't distinguish them.  In this case, we throw an exception rather than returning the wrong object.
+    PyObject *mp = master_hash_table_query(member);
+    if (mp && !PyObject_IsInstance(mp, (PyObject *) xconverter<U>::type->tobj))
+	throw std::runtime_error("pyclops: return_reference_internal: returned object has the same address as an object of another type (data member at offset zero?)");
+
+    // The aliasing constructor of shared_ptr<> gives a pointer to 'member' which shares ownership with 'self'.
+    // Therefore, the python object returned by to_python() holds a reference to 'self', via class_wrapper::ref.
+    std::shared_ptr<C> parent = extension_type<C>::shared_ptr_from_python(xconverter<C>::type->tobj, py_object::borrowed_reference(sp));
+    std::shared_ptr<U> ret(parent, member);
+
+    return xconverter<U>::type->to_python(ret);
+}
+
+
+template<typename R>
+struct _rv_policy<return_reference_internal, R>
+{
+    static_assert(std::is_lvalue_reference<R>::value || std::is_pointer<R>::value, "return_reference_internal policy: return type must be an lvalue reference or pointer");
+
+    // Note: we don't have a notion of "const" python objects, so a const reference is aliased as non-const.
+    using Rc = typename std::remove_pointer<typename std::remove_reference<R>::type>::type;
+    using U = typename std::remove_cv<Rc>::type;
+
+    static constexpr bool valid = has_xconverter<U>::value;
+
+    template<typename C>
+    static inline py_object to_python(C *self, R &&x) { return _reference_internal(self, const_cast<U *> (_addr(x))); }
+
+    static inline Rc *_addr(Rc &x) { return &x; }
+    static inline Rc *_addr(Rc *x) { return x; }
+};
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Comparison and hash slots.
+//
+// If T defines operator== and/or operator< (detected at compile time), then extension_type<T>::finalize()
+// installs a tp_richcompare which calls them directly, with no python-level method lookup.  If std::hash<T>
+// is also defined, it is used for tp_hash, so that wrapped value types work as dict keys or set members.
+// If T defines operator== but not std::hash<T>, the type is unhashable (following python's rule that
+// objects which compare equal must have equal hashes).  If T only defines operator<, then == falls
+// back to identity, and so does the hash.
+//
+// If __eq__, __hash__, etc. are added explicitly with add_method(), then the slots are not installed.
+// The slots are per-T, so if there is more than one extension_type for the same T, only the first
+// one to be finalized gets them.
+
+
+template<typename T, typename = void>
+struct _has_equal_op : std::false_type { };
+
+template<typename T>
+struct _has_equal_op<T, typename std::enable_if<std::is_convertible<decltype(std::declval<const T &>() == std::declval<const T &>()), bool>::value>::type> : std::true_type { };
+
+template<typename T, typename = void>
+struct _has_less_op : std::false_type { };
+
+template<typename T>
+struct _has_less_op<T, typename std::enable_if<std::is_convertible<decltype(std::declval<const T &>() < std::declval<const T &>()), bool>::value>::type> : std::true_type { };
+
+template<typename T, typename = void>
+struct _has_std_hash : std::false_type { };
+
+template<typename T>
+struct _has_std_hash<T, typename std::enable_if<std::is_convertible<decltype(std::hash<T>()(std::declval<const T &>())), size_t>::value>::type> : std::true_type { };
+
+
+// Helpers for tp_richcompare: return 0 or 1, or -1 if the comparison is not implemented.
+
+template<typename T, typename std::enable_if<_has_equal_op<T>::value,int>::type = 0>
+inline int _richcompare_eq(const T &a, const T &b, int op) { return (op == Py_EQ) ? (a == b) : !(a == b); }
+
+template<typename T, typename std::enable_if<!_has_equal_op<T>::value,int>::type = 0>
+inline int _richcompare_eq(const T &a, const T &b, int op) { return -1; }
+
+template<typename T, typename std::enable_if<_has_less_op<T>::value,int>::type = 0>
+inline int _richcompare_lt(const T &a, const T &b, int op)
+{
+    switch (op) {
+	case Py_LT: return (a < b);
+	case Py_GT: return (b < a);
+	case Py_LE: return !(b < a);
+	case Py_GE: return !(a < b);
+    }
+    return -1;
+}
+
+template<typename T, typename std::enable_if<!_has_less_op<T>::value,int>::type = 0>
+inline int _richcompare_lt(const T &a, const T &b, int op) { return -1; }
+
+
+template<typename T>
+struct _compare_slots {
+    static PyTypeObject *tobj;   // initialized in install()
+
+    static PyObject *tp_richcompare(PyObject *a, PyObject *b, int op);
+    static long tp_hash(PyObject *self);
+
+    template<typename U = T, typename std::enable_if<_has_std_hash<U>::value,int>::type = 0>
+    static inline hashfunc get_hash() { return tp_hash; }
+
+    template<typename U = T, typename std::enable_if<!_has_std_hash<U>::value && _has_equal_op<U>::value,int>::type = 0>
+    static inline hashfunc get_hash() { return PyObject_HashNotImplemented; }
+
+    // Identity hash, as for 'object'.  (This must be set explicitly, since python 2 doesn't inherit
+    // tp_hash when tp_richcompare is set.)
+    template<typename U = T, typename std::enable_if<!_has_std_hash<U>::value && !_has_equal_op<U>::value,int>::type = 0>
+    static inline hashfunc get_hash() { return PyBaseObject_Type.tp_hash; }
+
+    static inline void install(PyTypeObject *tobj, const std::vector<PyMethodDef> &methods);
+};
+
+
+template<typename T>
+PyTypeObject *_compare_slots<T>::tobj = nullptr;
+
+
+template<typename T>
+PyObject *_compare_slots<T>::tp_richcompare(PyObject *a, PyObject *b, int op)
+{
+    try {
+	// Comparisons with other types are deferred to python (e.g. to the other object's tp_richcompare).
+	if ((PyObject_IsInstance(a, (PyObject *)tobj) <= 0) || (PyObject_IsInstance(b, (PyObject *)tobj) <= 0)) {
+	    PyErr_Clear();
+	    Py_INCREF(Py_NotImplemented);
+	    return Py_NotImplemented;
+	}
+
+	const T *ta = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(a));
+	const T *tb = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(b));
+
+	int ret = ((op == Py_EQ) || (op == Py_NE)) ? _richcompare_eq(*ta, *tb, op) : _richcompare_lt(*ta, *tb, op);
+
+	PyObject *p = (ret < 0) ? Py_NotImplemented : (ret ? Py_True : Py_False);
+	Py_INCREF(p);
+	return p;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T>
+long _compare_slots<T>::tp_hash(PyObject *self)
+{
+    try {
+	const T *t = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(self));
+	long ret = (long) std::hash<T>() (*t);
+	return (ret != -1) ? ret : -2;   // -1 is reserved for errors
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return -1;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return -1;
+    }
+}
+
+
+template<typename T>
+inline void _compare_slots<T>::install(PyTypeObject *tp, const std::vector<PyMethodDef> &methods)
+{
+    if (!_has_equal_op<T>::value && !_has_less_op<T>::value)
+	return;
+
+    static const char *names[] = { "__eq__", "__ne__", "__lt__", "__le__", "__gt__", "__ge__", "__cmp__", "__hash__" };
+
+    for (const PyMethodDef &m: methods)
+	for (const char *name: names)
+	    if (!strcmp(m.ml_name, name))
+		return;
+
+    // Already installed for a different extension_type with the same C++ type (see above).
+    if (tobj && (tobj != tp))
+	return;
+
+    tobj = tp;
+    tp->tp_richcompare = tp_richcompare;
+    tp->tp_hash = get_hash();
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Number slots.
+//
+// If T defines arithmetic operators (detected at compile time), then extension_type<T>::finalize()
+// populates tp_as_number with slots which call them directly.  Currently supported:
+//
+//    a+b, a-b, a*b, a/b     binary operators, with both operands of type T, and a return type with a
+//                           to_python converter (usually T itself, which is moved into a new object)
+//    -a                     unary minus
+//    a+=b, a-=b, a*=b, a/=b in-place operators, which mutate the C++ object referenced by 'a',
+//                           and return 'a' (no new python object is created)
+//
+// The binary slots are called by the interpreter with the two operands, so there is no args tuple
+// and no method lookup.  Operands of other types give NotImplemented.  As with the comparison slots,
+// a slot is not installed if the corresponding method (e.g. __iadd__) was added with add_method().
+
+
+struct _op_add { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a + b) { return a + b; } };
+struct _op_sub { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a - b) { return a - b; } };
+struct _op_mul { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a * b) { return a * b; } };
+struct _op_div { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a / b) { return a / b; } };
+struct _op_iadd { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a += b) { return a += b; } };
+struct _op_isub { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a -= b) { return a -= b; } };
+struct _op_imul { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a *= b) { return a *= b; } };
+struct _op_idiv { template<typename A, typename B> static auto apply(A &a, B &b) -> decltype(a /= b) { return a /= b; } };
+
+
+// _has_binary_op<Op,T>: true if 'const T op const T' is defined, and its return value can be converted to python.
+template<typename Op, typename T, typename = void>
+struct _has_binary_op : std::false_type { };
+
+template<typename Op, typename T>
+struct _has_binary_op<Op, T, typename std::enable_if<converts_to_python<typename std::decay<decltype(Op::apply(std::declval<const T &>(), std::declval<const T &>()))>::type>::value>::type> : std::true_type { };
+
+// _has_inplace_op<Op,T>: true if 'T op= const T' is defined.
+template<typename Op, typename T, typename = void>
+struct _has_inplace_op : std::false_type { };
+
+template<typename Op, typename T>
+struct _has_inplace_op<Op, T, decltype((void) Op::apply(std::declval<T &>(), std::declval<const T &>()))> : std::true_type { };
+
+template<typename T, typename = void>
+struct _has_negate_op : std::false_type { };
+
+template<typename T>
+struct _has_negate_op<T, typename std::enable_if<converts_to_python<typename std::decay<decltype(-std::declval<const T &>())>::type>::value>::type> : std::true_type { };
+
+
+template<typename T>
+struct _number_slots {
+    static PyTypeObject *tobj;   // initialized in install()
+
+    template<typename Op> static PyObject *nb_binary(PyObject *a, PyObject *b);
+    template<typename Op> static PyObject *nb_inplace(PyObject *a, PyObject *b);
+    static PyObject *nb_negative(PyObject *a);
+
+    template<typename Op, typename std::enable_if<_has_binary_op<Op,T>::value,int>::type = 0>
+    static inline binaryfunc get_binary() { return nb_binary<Op>; }
+
+    template<typename Op, typename std::enable_if<!_has_binary_op<Op,T>::value,int>::type = 0>
+    static inline binaryfunc get_binary() { return NULL; }
+
+    template<typename Op, typename std::enable_if<_has_inplace_op<Op,T>::value,int>::type = 0>
+    static inline binaryfunc get_inplace() { return nb_inplace<Op>; }
+
+    template<typename Op, typename std::enable_if<!_has_inplace_op<Op,T>::value,int>::type = 0>
+    static inline binaryfunc get_inplace() { return NULL; }
+
+    template<typename U = T, typename std::enable_if<_has_negate_op<U>::value,int>::type = 0>
+    static inline unaryfunc get_negative() { return nb_negative; }
+
+    template<typename U = T, typename std::enable_if<!_has_negate_op<U>::value,int>::type = 0>
+    static inline unaryfunc get_negative() { return NULL; }
+
+    static inline void install(PyTypeObject *tobj, const std::vector<PyMethodDef> &methods);
+
+    // Helper for install(): sets slot to 'f', unless 'f' is NULL, or the slot is already set, or 'name' was added with add_method().
+    template<typename F>
+    static inline bool _set(F &slot, F f, const char *name, const std::vector<PyMethodDef> &methods);
+};
+
+
+template<typename T>
+PyTypeObject *_number_slots<T>::tobj = nullptr;
+
+
+template<typename T> template<typename Op>
+PyObject *_number_slots<T>::nb_binary(PyObject *a, PyObject *b)
+{
+    try {
+	// Note: the interpreter calls the slot if either operand is an instance, so we need to check both.
+	if ((PyObject_IsInstance(a, (PyObject *)tobj) <= 0) || (PyObject_IsInstance(b, (PyObject *)tobj) <= 0)) {
+	    PyErr_Clear();
+	    Py_INCREF(Py_NotImplemented);
+	    return Py_NotImplemented;
+	}
+
+	const T *ta = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(a));
+	const T *tb = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(b));
+
+	using R = typename std::decay<decltype(Op::apply(*ta, *tb))>::type;
+	py_object ret = converter<R>::to_python(Op::apply(*ta, *tb));
+
+	PyObject *p = ret.ptr;
+	ret.ptr = NULL;  // steal reference
+	return p;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T> template<typename Op>
+PyObject *_number_slots<T>::nb_inplace(PyObject *a, PyObject *b)
+{
+    try {
+	if ((PyObject_IsInstance(a, (PyObject *)tobj) <= 0) || (PyObject_IsInstance(b, (PyObject *)tobj) <= 0)) {
+	    PyErr_Clear();
+	    Py_INCREF(Py_NotImplemented);
+	    return Py_NotImplemented;
+	}
+
+	T *ta = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(a));
+	const T *tb = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(b));
+
+	// Mutates *ta, and returns 'a' (new reference), so that no new python object is created.
+	Op::apply(*ta, *tb);
+	Py_INCREF(a);
+	return a;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T>
+PyObject *_number_slots<T>::nb_negative(PyObject *a)
+{
+    try {
+	const T *ta = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(a));
+
+	using R = typename std::decay<decltype(-(*ta))>::type;
+	py_object ret = converter<R>::to_python(-(*ta));
+
+	PyObject *p = ret.ptr;
+	ret.ptr = NULL;  // steal reference
+	return p;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T> template<typename F>
+inline bool _number_slots<T>::_set(F &slot, F f, const char *name, const std::vector<PyMethodDef> &methods)
+{
+    if (!f || slot)
+	return false;
+
+    for (const PyMethodDef &m: methods)
+	if (!strcmp(m.ml_name, name))
+	    return false;
+
+    slot = f;
+    return true;
+}
+
+
+template<typename T>
+inline void _number_slots<T>::install(PyTypeObject *tp, const std::vector<PyMethodDef> &methods)
+{
+    // The slots are per-T, so only the first extension_type for a given T gets them (as with the comparison slots).
+    if (tobj && (tobj != tp))
+	return;
+
+    // FIXME memory leak (never freed, but only allocated once per type).
+    PyNumberMethods *nb = tp->tp_as_number;
+    if (!nb) {
+	nb = new PyNumberMethods;
+	memset(nb, 0, sizeof(PyNumberMethods));
+    }
+
+    bool installed = false;
+    installed |= _set(nb->nb_add, get_binary<_op_add>(), "__add__", methods);
+    installed |= _set(nb->nb_subtract, get_binary<_op_sub>(), "__sub__", methods);
+    installed |= _set(nb->nb_multiply, get_binary<_op_mul>(), "__mul__", methods);
+    installed |= _set(nb->nb_divide, get_binary<_op_div>(), "__div__", methods);
+    installed |= _set(nb->nb_true_divide, get_binary<_op_div>(), "__truediv__", methods);
+    installed |= _set(nb->nb_negative, get_negative(), "__neg__", methods);
+    installed |= _set(nb->nb_inplace_add, get_inplace<_op_iadd>(), "__iadd__", methods);
+    installed |= _set(nb->nb_inplace_subtract, get_inplace<_op_isub>(), "__isub__", methods);
+    installed |= _set(nb->nb_inplace_multiply, get_inplace<_op_imul>(), "__imul__", methods);
+    installed |= _set(nb->nb_inplace_divide, get_inplace<_op_idiv>(), "__idiv__", methods);
+    installed |= _set(nb->nb_inplace_true_divide, get_inplace<_op_idiv>(), "__itruediv__", methods);
+
+    if (!installed) {
+	if (nb != tp->tp_as_number)
+	    delete nb;
+	return;
+    }
+
+    // Py_TPFLAGS_CHECKTYPES means that the binary slots are called with operands of arbitrary
+    // types (rather than after coercion), which nb_binary() handles by returning NotImplemented.
+    tobj = tp;
+    tp->tp_as_number = nb;
+    tp->tp_flags |= Py_TPFLAGS_CHECKTYPES;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Sequence and mapping slots.
+//
+// If T defines size() and operator[](ssize_t), and the element type has a to_python converter, then
+// extension_type<T>::finalize() populates sq_length, sq_item, mp_length and mp_subscript, so that
+// len(obj) and obj[i] are direct C calls (no args tuple or method lookup).  Negative indices count
+// from the end, and out-of-range indices raise IndexError.  If operator[] returns a non-const
+// reference, and the element type has a from_python converter, then sq_ass_item and mp_ass_subscript
+// are also populated (using assign_from_python(), see pyclops/converters.hpp).
+//
+// Slices: if T also defines data(), returning a pointer to contiguous elements of an arithmetic or
+// complex type (e.g. std::vector<float>), then obj[i:j:k] returns a zero-copy numpy view which holds
+// a reference to 'obj', and slice assignment writes through such a view.  Note that as with any view,
+// the view is invalidated if the C++ container is later resized.  Otherwise, obj[i:j:k] returns a list
+// of converted elements, and slice assignment requires a sequence of the same length.
+//
+// Note that elements are converted by value, so for a container of extension types, obj[i] is a copy.
+//
+// The slots are not installed if __getitem__ or __len__ were added with add_method(), or if the
+// type already has tp_as_sequence or tp_as_mapping (e.g. soa_array, see pyclops/soa_array.hpp).
+
+
+template<typename T, typename = void>
+struct _has_size : std::false_type { };
+
+template<typename T>
+struct _has_size<T, typename std::enable_if<std::is_convertible<decltype(std::declval<const T &>().size()), ssize_t>::value>::type> : std::true_type { };
+
+// _subscript_type<T>::type is the return type of operator[], or void if it doesn't exist.
+template<typename T, typename = void>
+struct _subscript_type { using type = void; };
+
+template<typename T>
+struct _subscript_type<T, decltype((void) std::declval<T &>()[ssize_t(0)])> { using type = decltype(std::declval<T &>()[ssize_t(0)]); };
+
+// _has_subscript<T>: true if T::size() and T::operator[] exist, and the element can be converted to python.
+template<typename T, typename = void>
+struct _has_subscript : std::false_type { };
+
+template<typename T>
+struct _has_subscript<T, typename std::enable_if<_has_size<T>::value && !std::is_void<typename _subscript_type<T>::type>::value && converts_to_python<typename std::decay<typename _subscript_type<T>::type>::type>::value>::type> : std::true_type { };
+
+// _has_ass_subscript<T>: true if operator[] returns a non-const reference, and the element can be converted from python.
+template<typename T, typename = void>
+struct _has_ass_subscript : std::false_type { };
+
+template<typename T>
+struct _has_ass_subscript<T, typename std::enable_if<_has_subscript<T>::value>::type> : std::integral_constant<bool,
+    std::is_lvalue_reference<typename _subscript_type<T>::type>::value
+    && !std::is_const<typename std::remove_reference<typename _subscript_type<T>::type>::type>::value
+    && converts_from_python<typename std::decay<typename _subscript_type<T>::type>::type>::value>
+{ };
+
+// _has_contiguous_data<T>: true if T::data() returns a pointer to the elements, with a numpy typenum.
+template<typename T, typename = void>
+struct _has_contiguous_data : std::false_type { };
+
+template<typename T>
+struct _has_contiguous_data<T, typename std::enable_if<_has_subscript<T>::value && std::is_pointer<decltype(std::declval<T &>().data())>::value>::type> : std::integral_constant<bool,
+    std::is_same<typename std::remove_cv<typename std::remove_pointer<decltype(std::declval<T &>().data())>::type>::type,
+		 typename std::decay<typename _subscript_type<T>::type>::type>::value
+    && _npy_vector_element<typename std::decay<typename _subscript_type<T>::type>::type>::value>
+{ };
+
+
+template<typename T>
+struct _sequence_slots {
+    using E = typename std::decay<typename _subscript_type<T>::type>::type;
+
+    static PyTypeObject *tobj;   // initialized in install()
+
+    static Py_ssize_t sq_length(PyObject *self);
+    static PyObject *sq_item(PyObject *self, Py_ssize_t i);
+    static int sq_ass_item(PyObject *self, Py_ssize_t i, PyObject *value);
+    static PyObject *mp_subscript(PyObject *self, PyObject *key);
+    static int mp_ass_subscript(PyObject *self, PyObject *key, PyObject *value);
+
+    // Helpers for the slots.
+    static inline T *_get(PyObject *self);
+    static inline ssize_t _index(T *x, ssize_t i);
+    static inline void _set_item(T *x, ssize_t i, PyObject *value);
+
+    template<typename U = T, typename std::enable_if<_has_contiguous_data<U>::value,int>::type = 0>
+    static inline py_object _get_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n);
+
+    template<typename U = T, typename std::enable_if<!_has_contiguous_data<U>::value,int>::type = 0>
+    static inline py_object _get_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n);
+
+    template<typename U = T, typename std::enable_if<_has_contiguous_data<U>::value,int>::type = 0>
+    static inline void _set_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n, PyObject *value);
+
+    template<typename U = T, typename std::enable_if<!_has_contiguous_data<U>::value,int>::type = 0>
+    static inline void _set_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n, PyObject *value);
+
+    template<typename U = T, typename std::enable_if<_has_ass_subscript<U>::value,int>::type = 0>
+    static inline void _install_ass(PySequenceMethods *sq, PyMappingMethods *mp) { sq->sq_ass_item = sq_ass_item; mp->mp_ass_subscript = mp_ass_subscript; }
+
+    template<typename U = T, typename std::enable_if<!_has_ass_subscript<U>::value,int>::type = 0>
+    static inline void _install_ass(PySequenceMethods *sq, PyMappingMethods *mp) { }
+
+    template<typename U = T, typename std::enable_if<_has_subscript<U>::value,int>::type = 0>
+    static inline void install(PyTypeObject *tobj, const std::vector<PyMethodDef> &methods);
+
+    template<typename U = T, typename std::enable_if<!_has_subscript<U>::value,int>::type = 0>
+    static inline void install(PyTypeObject *tobj, const std::vector<PyMethodDef> &methods) { }
+};
+
+
+template<typename T>
+PyTypeObject *_sequence_slots<T>::tobj = nullptr;
+
+
+template<typename T>
+inline T *_sequence_slots<T>::_get(PyObject *self)
+{
+    return extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(self));
+}
+
+
+// Checks range (raising IndexError).  Negative indices are not wrapped here, since sq_item() and
+// sq_ass_item() are called with indices which have already been wrapped (by PySequence_GetItem()
+// etc., or by mp_subscript() and mp_ass_subscript()).
+template<typename T>
+inline ssize_t _sequence_slots<T>::_index(T *x, ssize_t i)
+{
+    ssize_t n = x->size();
+
+    if ((i < 0) || (i >= n)) {
+	PyErr_Format(PyExc_IndexError, "%s index out of range", tobj->tp_name);
+	throw pyerr_occurred();
+    }
+
+    return i;
+}
+
+
+template<typename T>
+inline void _sequence_slots<T>::_set_item(T *x, ssize_t i, PyObject *value)
+{
+    if (!value) {
+	PyErr_Format(PyExc_TypeError, "%s doesn't support item deletion", tobj->tp_name);
+	throw pyerr_occurred();
+    }
+
+    assign_from_python((*x)[i], py_object::borrowed_reference(value), tobj->tp_name);
+}
+
+
+template<typename T> template<typename U, typename std::enable_if<_has_contiguous_data<U>::value,int>::type>
+inline py_object _sequence_slots<T>::_get_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n)
+{
+    // Zero-copy view, which holds a reference to 'self'.  Writeable if data() is non-const.
+    auto *data = x->data();
+    bool writeable = !std::is_const<typename std::remove_pointer<decltype(data)>::type>::value;
+
+    npy_intp shape = n;
+    npy_intp stride = step * sizeof(E);
+    void *p = const_cast<E *> (data + start);
+    int flags = writeable ? NPY_ARRAY_WRITEABLE : 0;
+
+    return py_array::from_pointer(1, &shape, &stride, sizeof(E), p, npy_type<E>::id, flags, py_object::borrowed_reference(self));
+}
+
+
+template<typename T> template<typename U, typename std::enable_if<!_has_contiguous_data<U>::value,int>::type>
+inline py_object _sequence_slots<T>::_get_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n)
+{
+    py_list ret;
+    for (ssize_t k = 0; k < n; k++)
+	ret.append(converter<E>::to_python((*x)[start + k*step]));
+    return ret;
+}
+
+
+template<typename T> template<typename U, typename std::enable_if<_has_contiguous_data<U>::value,int>::type>
+inline void _sequence_slots<T>::_set_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n, PyObject *value)
+{
+    py_array view = _get_slice(x, self, start, step, n);
+
+    // Handles broadcasting and dtype conversion.
+    if (PyArray_CopyObject(view.aptr(), value) < 0)
+	throw pyerr_occurred();
+}
+
+
+template<typename T> template<typename U, typename std::enable_if<!_has_contiguous_data<U>::value,int>::type>
+inline void _sequence_slots<T>::_set_slice(T *x, PyObject *self, ssize_t start, ssize_t step, ssize_t n, PyObject *value)
+{
+    py_object seq = py_object::new_reference(PySequence_Fast(value, "slice assignment requires a sequence"));
+
+    if (PySequence_Fast_GET_SIZE(seq.ptr) != n) {
+	PyErr_Format(PyExc_ValueError, "%s: slice assignment can't change the container size", tobj->tp_name);
+	throw pyerr_occurred();
+    }
+
+    for (ssize_t k = 0; k < n; k++)
+	_set_item(x, start + k*step, PySequence_Fast_GET_ITEM(seq.ptr, k));
+}
+
+
+template<typename T>
+Py_ssize_t _sequence_slots<T>::sq_length(PyObject *self)
+{
+    try {
+	return _get(self)->size();
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return -1;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return -1;
+    }
+}
+
+
+template<typename T>
+PyObject *_sequence_slots<T>::sq_item(PyObject *self, Py_ssize_t i)
+{
+    try {
+	T *x = _get(self);
+	i = _index(x, i);
+
+	py_object ret = converter<E>::to_python((*x)[i]);
+	PyObject *p = ret.ptr;
+	ret.ptr = NULL;  // steal reference
+	return p;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T>
+int _sequence_slots<T>::sq_ass_item(PyObject *self, Py_ssize_t i, PyObject *value)
+{
+    try {
+	T *x = _get(self);
+	_set_item(x, _index(x,i), value);
+	return 0;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return -1;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return -1;
+    }
+}
+
+
+template<typename T>
+PyObject *_sequence_slots<T>::mp_subscript(PyObject *self, PyObject *key)
+{
+    try {
+	T *x = _get(self);
+
+	if (PySlice_Check(key)) {
+	    Py_ssize_t start, stop, step, n;
+	    if (PySlice_GetIndicesEx((PySliceObject *) key, x->size(), &start, &stop, &step, &n) < 0)
+		throw pyerr_occurred();
+
+	    py_object ret = _get_slice(x, self, start, step, n);
+	    PyObject *p = ret.ptr;
+	    ret.ptr = NULL;  // steal reference
+	    return p;
+	}
+
+	if (!PyIndex_Check(key)) {
+	    PyErr_Format(PyExc_TypeError, "%s indices must be integers or slices", tobj->tp_name);
+	    return NULL;
+	}
+
+	Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+	if ((i == -1) && PyErr_Occurred())
+	    return NULL;
+	if (i < 0)
+	    i += x->size();
+
+	return sq_item(self, i);
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T>
+int _sequence_slots<T>::mp_ass_subscript(PyObject *self, PyObject *key, PyObject *value)
+{
+    try {
+	T *x = _get(self);
+
+	if (PySlice_Check(key)) {
+	    Py_ssize_t start, stop, step, n;
+	    if (PySlice_GetIndicesEx((PySliceObject *) key, x->size(), &start, &stop, &step, &n) < 0)
+		throw pyerr_occurred();
+
+	    if (!value) {
+		PyErr_Format(PyExc_TypeError, "%s doesn't support item deletion", tobj->tp_name);
+		return -1;
+	    }
+
+	    _set_slice(x, self, start, step, n, value);
+	    return 0;
+	}
+
+	if (!PyIndex_Check(key)) {
+	    PyErr_Format(PyExc_TypeError, "%s indices must be integers or slices", tobj->tp_name);
+	    return -1;
+	}
+
+	Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+	if ((i == -1) && PyErr_Occurred())
+	    return -1;
+	if (i < 0)
+	    i += x->size();
+
+	return sq_ass_item(self, i, value);
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return -1;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return -1;
+    }
+}
+
+
+template<typename T> template<typename U, typename std::enable_if<_has_subscript<U>::value,int>::type>
+inline void _sequence_slots<T>::install(PyTypeObject *tp, const std::vector<PyMethodDef> &methods)
+{
+    if (tp->tp_as_sequence || tp->tp_as_mapping)
+	return;
+
+    static const char *names[] = { "__len__", "__getitem__", "__setitem__" };
 
-    // Use this constructor if there is a python-wrapped base class (i.e. B != T).
-    // The constructor will check (via static_assert) that E::wrapped_type == B.
-    template<typename E>
-    inline extension_type(const std::string &name, const std::string &docstring, E &base);
-    
-    inline void add_constructor(std::function<T* (py_object,py_tuple,py_dict)> f);
+    for (const PyMethodDef &m: methods)
+	for (const char *name: names)
+	    if (!strcmp(m.ml_name, name))
+		return;
 
-    // The 'f' argument will usually be obtained from wrap_method(), in pyclops/functional_wrappers.hpp.
-    inline void add_method(const std::string &name, const std::string &docstring, std::function<py_object(T *,py_tuple,py_dict)> f);
+    // The slots are per-T, so only the first extension_type for a given T gets them (as with the comparison slots).
+    if (tobj && (tobj != tp))
+	return;
 
-    // The 'f' argument will usually be obtained from wrap_func(), in pyclops/functional_wrappers.hpp.
-    inline void add_staticmethod(const std::string &name, const std::string &docstring, std::function<py_object(py_tuple,py_dict)> f);
+    // FIXME memory leak (never freed, but only allocated once per type).
+    PySequenceMethods *sq = new PySequenceMethods;
+    PyMappingMethods *mp = new PyMappingMethods;
+    memset(sq, 0, sizeof(PySequenceMethods));
+    memset(mp, 0, sizeof(PyMappingMethods));
+
+    sq->sq_length = sq_length;
+    sq->sq_item = sq_item;
+    mp->mp_length = sq_length;
+    mp->mp_subscript = mp_subscript;
+    _install_ass(sq, mp);
+
+    tobj = tp;
+    tp->tp_as_sequence = sq;
+    tp->tp_as_mapping = mp;
+}
 
-    // General property API.
-    inline void add_property(const std::string &name, const std::string &docstring, const std::function<py_object(py_object)> &f_get);
-    inline void add_property(const std::string &name, const std::string &docstring, const std::function<py_object(py_object)> &f_get, const std::function<void(py_object,py_object)> &f_set);
 
-    // This more specific API suffices for simple properties.
-    //    struct X { int x; ... };
-    //    std::function<int(const X*)> f_ro = [](const X *self) { return self->x; };
-    //    std::function<int& (X*)> f_rw = [](X *self) -> int& { return self->x; };
+// -------------------------------------------------------------------------------------------------
+//
+// Iterator slots.
+//
+// If T defines begin() and end(), and the element type has a to_python converter, then
+// extension_type<T>::finalize() populates tp_iter, so that 'for x in obj' iterates over the C++
+// range directly (rather than materializing a list).  The iterator holds a reference to 'obj',
+// so the container stays alive while it is being iterated.
+//
+// If the element type is an arithmetic or complex type, then finalize() also adds a method
+//
+//    obj.iter_chunks(K)
+//
+// which returns an iterator over numpy arrays of K elements (the last array may be shorter).
+// This reduces the number of python-level iterations by a factor K.  Each array is a copy
+// (rather than a view), so it remains valid after the iterator advances.
+//
+// As in C++, the iterator is invalidated if the container is resized during iteration.
+//
+// Not installed if __iter__ was added with add_method(), or if tp_iter was already set.
 
-    template<typename R>
-    inline void add_property(const std::string &name, const std::string &docstring, const std::function<R(const T *)> &f);
 
-    template<typename R>
-    inline void add_property(const std::string &name, const std::string &docstring, const std::function<R& (T *)> &f);
+template<typename T, typename = void>
+struct _has_range : std::false_type { };
 
-    // Sets the 'finalize' flag.
-    // Note: this is called automatically in extension_module::add_type().
-    inline void finalize();
+template<typename T>
+struct _has_range<T, typename std::enable_if<std::is_same<decltype(std::declval<T &>().begin()), decltype(std::declval<T &>().end())>::value
+					     && converts_to_python<typename std::decay<decltype(*std::declval<T &>().begin())>::type>::value>::type> 
+    : std::true_type { };
 
-    // These guys are intended to be wrapped by converters.
-    // FIXME wouldn't it be better to make them member functions?
-    static inline T *bare_pointer_from_python(PyTypeObject *tobj, const py_object &obj, const char *where=nullptr);
-    static inline std::shared_ptr<T> shared_ptr_from_python(PyTypeObject *tobj, const py_object &obj, const char *where=nullptr);
 
-    // This version of to_python() is "the" to_python converter for the wrapped type T.
-    // It checks for an empty pointer, checks the master_hash_table, and checks all of the derived_types.
-    inline py_object to_python(const std::shared_ptr<T> &x);
+// Primary template: T is not a range, so install() does nothing.
+template<typename T, bool = _has_range<T>::value>
+struct _iterator_slots {
+    static inline void install(PyTypeObject *tobj, std::vector<PyMethodDef> &methods) { }
+};
 
-    static inline void tp_dealloc(PyObject *self);
 
-    // This version of _to_python() is called recursively via the base class.
-    // (See _extension_subtype above.)
-    inline PyObject *_to_python(const std::shared_ptr<B> &x) override;
+template<typename T>
+struct _iterator_slots<T,true> {
+    using It = decltype(std::declval<T &>().begin());
+    using E = typename std::decay<decltype(*std::declval<It &>())>::type;
+
+    // The python iterator object.  The C++ iterators are constructed with placement new.
+    struct iterator_object {
+	PyObject_HEAD
+	PyObject *parent;   // holds reference
+	It curr;
+	It end;
+	ssize_t chunk_size;    // if zero, iterate over elements (rather than chunks)
+    };
 
-    // Helper function called by constructors.
-    inline void _construct(const std::string &name, const std::string &docstring);
+    static PyTypeObject *tobj;    // initialized in install()
+    static PyTypeObject *itobj;   // iterator type, initialized in install()
 
-    // Helper function called by to_python() and _to_python().
-    // Returns new reference; never returns NULL.
-    inline PyObject *_make(const std::shared_ptr<T> &p);
+    static PyObject *make_iterator(PyObject *self, ssize_t chunk_size);
 
-    // Allocated and initialized at construction.
-    PyTypeObject *tobj = nullptr;
+    static PyObject *tp_iter(PyObject *self);
+    static PyObject *tp_iternext(PyObject *self);
+    static void tp_dealloc(PyObject *self);
+    static PyObject *iter_chunks(PyObject *self, PyObject *args);
 
-    // Note: bare pointer to std::vector is intentional here!
-    std::vector<PyMethodDef> *methods = nullptr;     // (name, cfunc, flags, docstring)
-    std::vector<PyGetSetDef> *getsetters = nullptr;  // (name, getter, setter, doc, closure)
-    bool finalized = false;                          // if true, no methods or getsetters may be added.
+    // Sets 'ret' to a py_array of up to chunk_size elements, or returns false if the iterator is exhausted.
+    // Chunked iteration is only defined if E is an arithmetic or complex type.
+    template<bool C = _npy_vector_element<E>::value, typename std::enable_if<C,int>::type = 0>
+    static inline bool _next_chunk(iterator_object *ip, py_object &ret);
 
-    // Note: base_types have pointers to their derived_types, but not vice versa!
-    // Note: it's OK to add derived_types after the 'finalized' flag is set.
-    // This is because new derived types may be defined at any time (e.g. when another module is imported).
-    std::vector<_extension_subtype<T> *> derived_types;
+    template<bool C = _npy_vector_element<E>::value, typename std::enable_if<C,int>::type = 0>
+    static inline void _add_iter_chunks(std::vector<PyMethodDef> &methods);
+
+    template<bool C = _npy_vector_element<E>::value, typename std::enable_if<!C,int>::type = 0>
+    static inline bool _next_chunk(iterator_object *ip, py_object &ret) { throw std::runtime_error("pyclops internal error: _next_chunk() called for non-numeric type"); }
+
+    template<bool C = _npy_vector_element<E>::value, typename std::enable_if<!C,int>::type = 0>
+    static inline void _add_iter_chunks(std::vector<PyMethodDef> &methods) { }
+
+    static inline void install(PyTypeObject *tobj, std::vector<PyMethodDef> &methods);
 };
 
 
-// FIXME superseded by 'class virtual function', should it be removed?
-inline py_object _py_upcall(void *self, const char *meth_name, const py_tuple &args);
+template<typename T>
+PyTypeObject *_iterator_slots<T,true>::tobj = nullptr;
 
+template<typename T>
+PyTypeObject *_iterator_slots<T,true>::itobj = nullptr;
 
 
-// -------------------------------------------------------------------------------------------------
-//
-// xconverter: used to define converters for extension_types.
-//
-// FIXME should this code be moved elsewhere?
-// FIXME 'xconverter' needs better name!
-//
-// FIXME has_xconverter could be improved (just checks that static member function 'type' exists and is a pointer)
+template<typename T>
+PyObject *_iterator_slots<T,true>::make_iterator(PyObject *self, ssize_t chunk_size)
+{
+    T *x = extension_type<T>::bare_pointer_from_python(tobj, py_object::borrowed_reference(self));
 
+    iterator_object *ip = PyObject_New(iterator_object, itobj);
+    if (!ip)
+	throw pyerr_occurred();
 
-// expects 'static constexpr extension_type<T,B> *type = ...'
-template<typename T> struct xconverter;
+    new(&ip->curr) It(x->begin());   // "placement new"
+    new(&ip->end) It(x->end());
 
+    Py_INCREF(self);
+    ip->parent = self;
+    ip->chunk_size = chunk_size;
+
+    return reinterpret_cast<PyObject *> (ip);
+}
 
-template<typename T, typename = void>
-struct has_xconverter : std::false_type { };
 
 template<typename T>
-struct has_xconverter<T, typename std::enable_if<std::is_pointer<decltype(xconverter<T>::type)>::value>::type> : std::true_type { };
+PyObject *_iterator_slots<T,true>::tp_iter(PyObject *self)
+{
+    try {
+	return make_iterator(self, 0);
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
 
 
 template<typename T>
-struct predicated_converter<T&, typename std::enable_if<has_xconverter<T>::value>::type>
+PyObject *_iterator_slots<T,true>::iter_chunks(PyObject *self, PyObject *args)
 {
-    static inline T& from_python(const py_object &x, const char *where=nullptr)
-    {
-	auto p = extension_type<T>::shared_ptr_from_python(xconverter<T>::type->tobj, x, where);
-	return *p;
+    Py_ssize_t chunk_size = 0;
+    if (!PyArg_ParseTuple(args, "n:iter_chunks", &chunk_size))
+	return NULL;
+
+    if (chunk_size <= 0) {
+	PyErr_SetString(PyExc_ValueError, "iter_chunks(): chunk size must be positive");
+	return NULL;
     }
-};
+
+    try {
+	return make_iterator(self, chunk_size);
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
 
 
-template<typename T>
-struct predicated_converter<std::shared_ptr<T>, typename std::enable_if<has_xconverter<T>::value>::type>
+template<typename T> template<bool C, typename std::enable_if<C,int>::type>
+inline bool _iterator_slots<T,true>::_next_chunk(iterator_object *ip, py_object &ret)
 {
-    static std::shared_ptr<T> from_python(const py_object &obj, const char *where=nullptr)
-    {
-	return extension_type<T>::shared_ptr_from_python(xconverter<T>::type->tobj, obj, where);
+    npy_intp n = ip->chunk_size;
+    py_array a = py_array::make(1, &n, npy_type<E>::id);
+    E *dst = reinterpret_cast<E *> (a.data());
+
+    npy_intp m = 0;
+    while ((m < n) && (ip->curr != ip->end)) {
+	dst[m++] = *ip->curr;
+	++ip->curr;
     }
-	
-    static py_object to_python(const std::shared_ptr<T> &x)
-    {
-	return xconverter<T>::type->to_python(x);
+
+    if (m == 0)
+	return false;
+
+    if (m < n) {
+	// Last chunk is shorter (one extra copy, but only once per iteration).
+	py_array b = py_array::make(1, &m, npy_type<E>::id);
+	memcpy(b.data(), a.data(), m * sizeof(E));
+	a = b;
     }
-};
 
+    ret = a;
+    return true;
+}
 
-// FIXME invokes copy constructor - should diasable this template if no copy constructor defined.
-// Even if copy constructor is defined, it may be a hidden source of overhead - should there be a boolean
-// flag somewhere to enable this template?
 
 template<typename T>
-struct predicated_converter<T, typename std::enable_if<has_xconverter<T>::value>::type>
+PyObject *_iterator_slots<T,true>::tp_iternext(PyObject *self)
 {
-    static inline py_object to_python(const T &x)
-    {
-	auto p = std::make_shared<T> (x);
-	return xconverter<T>::type->to_python(p);
+    try {
+	iterator_object *ip = reinterpret_cast<iterator_object *> (self);
+	py_object ret;
+
+	if (ip->chunk_size > 0) {
+	    if (!_next_chunk(ip, ret))
+		return NULL;  // StopIteration (no exception needs to be set)
+	}
+	else {
+	    if (ip->curr == ip->end)
+		return NULL;  // StopIteration
+	    ret = converter<E>::to_python(*ip->curr);
+	    ++ip->curr;
+	}
+
+	PyObject *p = ret.ptr;
+	ret.ptr = NULL;  // steal reference
+	return p;
     }
-};
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T>
+void _iterator_slots<T,true>::tp_dealloc(PyObject *self)
+{
+    iterator_object *ip = reinterpret_cast<iterator_object *> (self);
+
+    ip->curr.~It();   // direct destructor call (counterpart of "placement new")
+    ip->end.~It();
+    Py_XDECREF(ip->parent);
+    PyObject_Del(self);
+}
+
+
+template<typename T> template<bool C, typename std::enable_if<C,int>::type>
+inline void _iterator_slots<T,true>::_add_iter_chunks(std::vector<PyMethodDef> &methods)
+{
+    for (const PyMethodDef &m: methods)
+	if (!strcmp(m.ml_name, "iter_chunks"))
+	    return;
+
+    PyMethodDef m;
+    m.ml_name = "iter_chunks";
+    m.ml_meth = iter_chunks;
+    m.ml_flags = METH_VARARGS;
+    m.ml_doc = "iter_chunks(K): returns iterator over numpy arrays of K elements";
+
+    methods.push_back(m);
+}
+
+
+template<typename T>
+inline void _iterator_slots<T,true>::install(PyTypeObject *tp, std::vector<PyMethodDef> &methods)
+{
+    if (tp->tp_iter)
+	return;
+
+    for (const PyMethodDef &m: methods)
+	if (!strcmp(m.ml_name, "__iter__"))
+	    return;
+
+    // The slots are per-T, so only the first extension_type for a given T gets them (as with the comparison slots).
+    if (tobj && (tobj != tp))
+	return;
+
+    // FIXME memory leak (never freed, but only allocated once per type).
+    const char *name = strdup((std::string(tp->tp_name) + "_iterator").c_str());
+    PyTypeObject *it = _make_static_type(name, nullptr, sizeof(iterator_object));
+    it->tp_dealloc = tp_dealloc;
+    it->tp_iter = PyObject_SelfIter;
+    it->tp_iternext = tp_iternext;
+
+    if (PyType_Ready(it) < 0)
+	throw pyerr_occurred("pyclops::_iterator_slots::install()");
+
+    tobj = tp;
+    itobj = it;
+    tp->tp_iter = tp_iter;
+
+    _add_iter_chunks(methods);
+}
 
 
 // -------------------------------------------------------------------------------------------------
@@ -178,6 +1378,22 @@ struct predicated_converter<T, typename std::enable_if<has_xconverter<T>::value>
 // Implementation.
 
 
+// Helpers for python-managed objects (see class_wrapper<T> below).  If T has an intrusive refcount,
+// then the PyObject holds one count.  Otherwise, the PyObject owns the C++ object outright.
+
+template<typename T, typename std::enable_if<!has_intrusive_refcount<T>::value,int>::type = 0>
+inline void _python_managed_acquire(T *p) { }
+
+template<typename T, typename std::enable_if<!has_intrusive_refcount<T>::value,int>::type = 0>
+inline void _python_managed_release(T *p) { delete p; }
+
+template<typename T, typename std::enable_if<has_intrusive_refcount<T>::value,int>::type = 0>
+inline void _python_managed_acquire(T *p) { intrusive_ptr_add_ref(p); }
+
+template<typename T, typename std::enable_if<has_intrusive_refcount<T>::value,int>::type = 0>
+inline void _python_managed_release(T *p) { intrusive_ptr_release(p); }
+
+
 // The class_wrapper<T> type is used "under the hood" to embed the shared_ptr<T> in a PyObject.
 // Members of class_wrapper<T> are only accessed by extension_type<T> (in this source file).
 
@@ -205,7 +1421,9 @@ struct class_wrapper {
     // The precise semantics of the 'ref' field are nontrivial to explain!
     //
     // An object can either be "C++ managed" if it was originally constructed in C++,
-    // or "python-managed" if originally constructed in python.
+    // or "python-managed" if originally constructed in python.  (An exception: objects
+    // returned to python as a std::unique_ptr<T> are python-managed, since ownership
+    // is transferred to the PyObject.)
     //
     // If an object is C++ managed, then 'ref' will be a nonempty shared_ptr<> which
     // is constructed in tp_init() and destroyed in tp_dealloc().  When the PyObject
@@ -221,6 +1439,10 @@ struct class_wrapper {
     // responsible for decrementing the refcount.  In this scenario, the PyObject's
     // lifetime and the C++ object's lifetime are always the same.
     //
+    // Exception: if T has an intrusive refcount (see pyclops/intrusive_ptr.hpp), then a
+    // python-managed object holds one count (rather than deleting 'p' directly), so that
+    // the C++ object can outlive the PyObject if C++ code holds an intrusive_ptr<T>.
+    //
     // Note that 'ref' is constructed with "placement new" and destroyed with a direct
     // destructor call.  I wanted to avoid making the assumption that a binary-zeroed
     // shared_ptr<> is a valid (empty) pointer.  Therefore, there is an invariant that
@@ -237,6 +1459,7 @@ struct class_wrapper {
     //         'ref' is a valid shared_ptr
     //         if ref is an empty pointer:
     //             object is python-managed
+    //             if T has an intrusive refcount, the PyObject holds one count
     //         else:
     //             object is C++ managed
     //             'ref' points to 'p'.
@@ -277,24 +1500,13 @@ inline void extension_type<T,B>::_construct(const std::string &name, const std::
     this->methods = new std::vector<PyMethodDef> ();
     this->getsetters = new std::vector<PyGetSetDef> ();
 
-    // This is probably silly, but I decided to overallocate the PyTypeObject to avoid
-    // a possible segfault if the python interpreter gets recompiled with -DCOUNT_ALLOCS.
-    ssize_t nalloc = sizeof(PyTypeObject) + 128;
-    tobj = (PyTypeObject *) malloc(nalloc);   // FIXME check for failed allocation
-    memset(tobj, 0, nalloc);
-
-    // Idiomatic initialization produces superfluous warnings with gcc5
-    // PyObject_INIT((PyVarObject *) tobj, NULL);
-
-    // This initialization is equivalent (see Include/objimpl.h in python interpreter source code)
-    _Py_NewReference(tobj);
-
-    tobj->tp_name = strdup(name.c_str());
-    tobj->tp_doc = strdup(docstring.c_str());
-    tobj->tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE;
-    tobj->tp_basicsize = sizeof(class_wrapper<T>);
+    tobj = _make_static_type(strdup(name.c_str()), strdup(docstring.c_str()), sizeof(class_wrapper<T>));
+    tobj->tp_flags |= Py_TPFLAGS_BASETYPE;
     tobj->tp_new = PyType_GenericNew;
     tobj->tp_dealloc = extension_type<T>::tp_dealloc;
+
+    // Object counts (see pyclops/type_stats.hpp).
+    this->stats = make_type_stats(tobj, sizeof(T));
 }
 
 
@@ -308,7 +1520,9 @@ inline void extension_type<T,B>::add_constructor(std::function<T* (py_object, py
 
     PyTypeObject *type = this->tobj;
 
-    auto tp_init = [f,type](py_object self, py_tuple args, py_dict kwds) -> void {
+    type_stats *stats = this->stats;
+
+    auto tp_init = [f,type,stats](py_object self, py_tuple args, py_dict kwds) -> void {
 	if (!PyObject_IsInstance(self.ptr, (PyObject *)type))
 	    throw std::runtime_error(std::string(type->tp_name) + ": 'self' argument to __init__() does not have expected type?!");
 
@@ -323,11 +1537,14 @@ inline void extension_type<T,B>::add_constructor(std::function<T* (py_object, py
 	// Initialize new python-managed object.
 	master_hash_table_add(tp, self.ptr);
 	new(&wp->ref) std::shared_ptr<T> ();   // "placement new"
+	_python_managed_acquire(tp);
 	wp->p = tp;
+
+	stats->add(false);
     };
 
     // Convert std::function to C-style function pointer.
-    tobj->tp_init = make_kwargs_initproc(tp_init);
+    tobj->tp_init = make_kwargs_initproc(tp_init, (std::string(tobj->tp_name) + ".__init__").c_str());
 }
 
 
@@ -340,7 +1557,13 @@ inline void extension_type<T,B>::add_method(const std::string &name, const std::
     char *fname = strdup(name.c_str());
     PyTypeObject *tp = this->tobj;
 
-    auto py_method = [f,tp,fname](py_object self, py_tuple args, py_dict kwds) -> py_object {
+    // If 'f' was returned by wrap_method(), then we unpack it (to avoid an extra std::function
+    // call per python call), and remember the original C++ method (see find_cpp_callable()).
+    const _wrapped_method<T> *wm = f.template target<_wrapped_method<T>> ();
+    std::function<py_object(T*,py_tuple,py_dict)> fp = wm ? wm->py_func : f;
+    _cpp_binder bind;
+
+    auto py_method = [fp,tp,fname](py_object self, py_tuple args, py_dict kwds) -> py_object {
 	if (!PyObject_IsInstance(self.ptr, (PyObject *) tp))
 	    throw std::runtime_error(std::string(tp->tp_name) + "." + fname + ": expected 'self' of type " + tp->tp_name);
 
@@ -348,12 +1571,30 @@ inline void extension_type<T,B>::add_method(const std::string &name, const std::
 	if (!wp->p)
 	    throw std::runtime_error(std::string(tp->tp_name) + ".__init__() was never called (probably missing call in subclass constructor");
 
-	return f(wp->p, args, kwds);
+	return fp(wp->p, args, kwds);
     };
 
+    if (wm) {
+	std::shared_ptr<_cpp_method_base<T>> cm = wm->cpp_func;
+
+	bind = [cm,tp](PyObject *self) -> std::shared_ptr<_cpp_callable_base> {
+	    int is_instance = PyObject_IsInstance(self, (PyObject *) tp);
+	    if (is_instance <= 0) {
+		PyErr_Clear();
+		return std::shared_ptr<_cpp_callable_base> ();
+	    }
+
+	    auto *wp = reinterpret_cast<class_wrapper<T> *> (self);
+	    if (!wp->p)
+		return std::shared_ptr<_cpp_callable_base> ();
+
+	    return cm->bind(wp->p, self);
+	};
+    }
+
     PyMethodDef m;
     m.ml_name = fname;
-    m.ml_meth = make_kwargs_cmethod(py_method);
+    m.ml_meth = make_kwargs_cmethod(py_method, bind, (std::string(tp->tp_name) + "." + fname).c_str());
     m.ml_flags = METH_VARARGS | METH_KEYWORDS;
     m.ml_doc = strdup(docstring.c_str());
 
@@ -369,7 +1610,7 @@ inline void extension_type<T,B>::add_staticmethod(const std::string &name, const
 
     PyMethodDef m;
     m.ml_name = strdup(name.c_str());
-    m.ml_meth = make_kwargs_cfunction(f);
+    m.ml_meth = make_kwargs_cfunction(f, (std::string(tobj->tp_name) + "." + name).c_str());
     m.ml_flags = METH_STATIC | METH_VARARGS | METH_KEYWORDS;
     m.ml_doc = strdup(docstring.c_str());
 
@@ -458,9 +1699,11 @@ inline void extension_type<T,B>::add_property(const std::string &name, const std
 
     std::function<void(py_object,py_object)> f_set = [f,tp,cpropname](py_object self, py_object value) -> void
 	{
+	    // assign_from_python() writes directly into the existing R if the converter supports it
+	    // (e.g. std::vector resized in place), see pyclops/converters.hpp.
 	    T *cself = bare_pointer_from_python(tp, self, cpropname);
 	    R &cret = f(cself);
-	    cret = converter<R>::from_python(value);
+	    assign_from_python(cret, value, cpropname);
 	};
 
     this->add_property(name, docstring, f_get, f_set);
@@ -475,6 +1718,9 @@ inline void extension_type<T,B>::finalize()
     if (finalized)
 	throw std::runtime_error(std::string(tobj->tp_name) + ": double call to extension_type::finalize()");
 
+    // Must precede tp_methods initialization below, since it may add methods.
+    _iterator_slots<T>::install(tobj, *methods);
+
     // Note that we include zeroed sentinels.
 
     int nmethods = methods->size();
@@ -487,6 +1733,10 @@ inline void extension_type<T,B>::finalize()
     memset(tobj->tp_getset, 0, (ngetsetters+1) * sizeof(PyGetSetDef));
     memcpy(tobj->tp_getset, &(*getsetters)[0], ngetsetters * sizeof(PyGetSetDef));
 
+    _compare_slots<T>::install(tobj, *methods);
+    _number_slots<T>::install(tobj, *methods);
+    _sequence_slots<T>::install(tobj, *methods);
+
     this->finalized = true;
 }
 
@@ -525,6 +1775,28 @@ inline std::shared_ptr<T> extension_type<T,B>::shared_ptr_from_python(PyTypeObje
 }
 
 
+template<typename T, typename B>
+inline intrusive_ptr<T> extension_type<T,B>::intrusive_ptr_from_python(PyTypeObject *tobj, const py_object &obj, const char *where)
+{
+    static_assert(has_intrusive_refcount<T>::value, "extension_type::intrusive_ptr_from_python(): T does not have an intrusive refcount");
+
+    if (!PyObject_IsInstance(obj.ptr, (PyObject *) tobj))
+	throw std::runtime_error(std::string(where ? where : "pyclops") + ": expected object of type " + tobj->tp_name);
+
+    auto *wp = reinterpret_cast<class_wrapper<T> *> (obj.ptr);
+    if (!wp->p)
+	throw std::runtime_error(std::string(where ? where : "pyclops") + ": " + tobj->tp_name + ".__init__() was never called?!");
+
+    // If the object is C++ managed, then its lifetime is controlled by a shared_ptr, and the intrusive
+    // count can't keep it alive.
+    if (wp->ref)
+	throw std::runtime_error(std::string(where ? where : "pyclops") + ": " + tobj->tp_name + " object is owned by a shared_ptr, and can't be converted to intrusive_ptr");
+
+    // Object is python-managed, so the python object holds one count, and no control block is needed.
+    return intrusive_ptr<T> (wp->p);
+}
+
+
 template<typename T, typename B>
 inline py_object extension_type<T,B>::to_python(const std::shared_ptr<T> &x)
 {
@@ -550,6 +1822,32 @@ inline py_object extension_type<T,B>::to_python(const std::shared_ptr<T> &x)
 }
 
 
+template<typename T, typename B>
+inline py_object extension_type<T,B>::to_python(std::unique_ptr<T> &&x)
+{
+    // FIXME: same question as in to_python(const shared_ptr<T> &): should an empty pointer become None?
+    if (!x)
+	throw std::runtime_error("pyclops: empty pointer in to_python converter");
+
+    // If a python object already exists, then the object already has an owner, and adopting it
+    // would lead to a double delete.
+    if (master_hash_table_query(x.get()))
+	throw std::runtime_error(std::string(tobj->tp_name) + ": unique_ptr to_python converter: object is already owned by a python object");
+
+    for (const auto &d: derived_types) {
+	PyObject *p = d->_adopt(x.get());
+	if (p != NULL) {  // dynamic_cast succeeded, and python object now owns the pointer
+	    x.release();
+	    return py_object::new_reference(p);
+	}
+    }
+
+    PyObject *p = this->_make(x.get());
+    x.release();
+    return py_object::new_reference(p);
+}
+
+
 // Returns NULL if dynamic_pointer_cast fails (throws exception on miscellaneous failure).
 // Caller has checked that 'x' is a nonempty pointer, and x.get() is not in the master_hash_table.
 template<typename T, typename B>
@@ -570,6 +1868,49 @@ inline PyObject *extension_type<T,B>::_to_python(const std::shared_ptr<B> &x)
 }
 
 
+template<typename T, typename B>
+inline py_object extension_type<T,B>::to_python(const intrusive_ptr<T> &x)
+{
+    static_assert(has_intrusive_refcount<T>::value, "extension_type::to_python(): T does not have an intrusive refcount");
+
+    if (!x)
+	throw std::runtime_error("pyclops: empty pointer in to_python converter");
+
+    PyObject *obj = master_hash_table_query(x.get());
+    if (obj) 
+	return py_object::borrowed_reference(obj);
+
+    // The new python object holds its own count (see _make(T *)), so 'x' keeps its count.
+    for (const auto &d: derived_types) {
+	PyObject *p = d->_adopt(x.get());
+	if (p != NULL)  // dynamic_cast succeeded
+	    return py_object::new_reference(p);
+    }
+
+    return py_object::new_reference(this->_make(x.get()));
+}
+
+
+// Returns NULL if dynamic_cast fails.  If a python object is returned, it has taken ownership of 'x'.
+// Caller has checked that 'x' is non-NULL, and 'x' is not in the master_hash_table.
+template<typename T, typename B>
+inline PyObject *extension_type<T,B>::_adopt(B *x)
+{
+    T *y = dynamic_cast<T *> (x);
+
+    if (!y)
+	return NULL;
+
+    for (const auto &d: derived_types) {
+	PyObject *p = d->_adopt(y);
+	if (p != NULL)  // dynamic_cast succeeded
+	    return p;
+    }
+
+    return this->_make(y);
+}
+
+
 template<typename T, typename B>
 inline PyObject *extension_type<T,B>::_make(const std::shared_ptr<T> &x)
 {
@@ -586,6 +1927,26 @@ inline PyObject *extension_type<T,B>::_make(const std::shared_ptr<T> &x)
     wp->p = x.get();
     wp->ref = x;
 
+    this->stats->add(true);
+    return obj;
+}
+
+
+template<typename T, typename B>
+inline PyObject *extension_type<T,B>::_make(T *p)
+{
+    PyObject *obj = tobj->tp_alloc(tobj, 0);
+    if (!obj)
+	throw pyerr_occurred();
+
+    // Initialize new python-managed object (same as tp_init() in add_constructor()).
+    auto *wp = reinterpret_cast<class_wrapper<T> *> (obj);
+    master_hash_table_add(p, obj);
+    new(&wp->ref) std::shared_ptr<T> ();   // "placement new"
+    _python_managed_acquire(p);
+    wp->p = p;
+
+    this->stats->add(false);
     return obj;
 }
 
@@ -605,14 +1966,22 @@ inline void extension_type<T,B>::tp_dealloc(PyObject *self)
     wp->p = nullptr;
     master_hash_table_remove((void *)p, self);
 
+    // Since tp_dealloc() is static, the type_stats are found from the python type.
+    type_stats *stats = find_type_stats(Py_TYPE(self));
+
     if (!wp->ref) {
 	// Object is python-managed, i.e. allocated with new() when python object
 	// is constructed, and deallocated with delete() when python object is destroyed.
-	delete p;
+	// (Or if T has an intrusive refcount, the python object's count is released.)
+	_python_managed_release(p);
+	if (stats)
+	    stats->remove(false);
 	return;
     }
 
     // Object is C++-managed, i.e. python object holds a reference via shared_ptr<>.
+    if (stats)
+	stats->remove(true);
     wp->ref.reset();
     wp->ref.~shared_ptr();  // direct destructor call (counterpart of "placement new")
 }
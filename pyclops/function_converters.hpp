@@ -0,0 +1,104 @@
+#ifndef _PYCLOPS_FUNCTION_CONVERTERS_HPP
+#define _PYCLOPS_FUNCTION_CONVERTERS_HPP
+
+#include <memory>
+#include <typeinfo>
+#include <functional>
+
+#include "core.hpp"
+#include "converters.hpp"
+#include "cfunction_table.hpp"
+#include "functional_wrappers.hpp"
+#include "gil_stats.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// converter<std::function<R(Ts...)>>: python callables as C++ callbacks.
+//
+// This allows wrapping C++ functions which take std::function arguments, e.g.
+//
+//   double integrate(std::function<double(double)> f, double lo, double hi);
+//   m.add_function("integrate", "integrate f over [lo,hi]", wrap_func(integrate, "f", "lo", "hi"));
+//
+// If the python callable is itself a C++ function, which was wrapped by wrap_func() (or a bound method
+// of an extension_type, wrapped by wrap_method()), and its C++ signature is exactly R(Ts...), then the
+// converter returns the original C++ callable, so that calls never go through python.  For example,
+// integrate(m.gaussian, 0, 1) calls the C++ gaussian() directly.  (Bound methods keep their python
+// instance alive, for the lifetime of the std::function.)
+//
+// Otherwise, the std::function upcalls the python callable: each call acquires the GIL, converts
+// the arguments with to_python converters, and converts the return value with a from_python converter.
+// The std::function may be called (and destroyed) from any thread.
+//
+// A python None is converted to an empty std::function.
+//
+// There is no to_python converter, since each wrapped function would need a new cfunction_table
+// entry (see pyclops/cfunction_table.hpp).
+
+
+// RAII wrapper for PyGILState_Ensure() / PyGILState_Release(), which also times the upcall to
+// python callable 'f' (see pyclops/gil_stats.hpp).
+struct _gil_ensure {
+    _gil_upcall_timer timer;   // declared first, so that it's initialized before the GIL is acquired
+    PyGILState_STATE gstate;
+
+    _gil_ensure(PyObject *f) : gstate(PyGILState_Ensure()) { timer.acquired(f); }
+    ~_gil_ensure() { timer.stop(); PyGILState_Release(gstate); }
+
+    _gil_ensure(const _gil_ensure &) = delete;
+    _gil_ensure &operator=(const _gil_ensure &) = delete;
+};
+
+
+template<typename R>
+struct _upcall_result {
+    static R convert(const py_object &x) { return converter<R>::from_python(x, "pyclops: std::function upcall return value"); }
+};
+
+template<>
+struct _upcall_result<void> {
+    static void convert(const py_object &x) { }
+};
+
+
+template<typename R, typename... Ts>
+inline R _upcall(PyObject *f, const Ts & ... args)
+{
+    _gil_ensure g(f);
+
+    py_tuple t = py_tuple::make(args...);
+    py_object ret = py_object::borrowed_reference(f).call(t);
+    return _upcall_result<R>::convert(ret);
+}
+
+
+template<typename R, typename... Ts>
+struct converter<std::function<R(Ts...)>> {
+    static std::function<R(Ts...)> from_python(const py_object &x, const char *where=NULL)
+    {
+	if (x.is_none())
+	    return std::function<R(Ts...)> ();
+
+	std::shared_ptr<_cpp_callable_base> cp = find_cpp_callable(x.ptr);
+
+	if (cp && (cp->signature() == typeid(R(Ts...))))
+	    return static_cast<_cpp_callable<R(Ts...)> *> (cp.get())->f;
+
+	if (!PyCallable_Check(x.ptr))
+	    throw std::runtime_error(std::string(where ? where : "pyclops") + ": expected callable object");
+
+	std::shared_ptr<PyObject> fp = _gil_safe_ref(x.ptr);
+	return [fp](Ts... args) -> R { return _upcall<R> (fp.get(), args...); };
+    }
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_FUNCTION_CONVERTERS_HPP
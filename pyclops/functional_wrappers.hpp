@@ -17,6 +17,10 @@
 
 #include "core.hpp"
 #include "converters.hpp"
+#include "cfunction_table.hpp"
+#include "call_stats.hpp"
+#include <memory>
+#include <typeinfo>
 #include <unordered_map>
 
 namespace pyclops {
@@ -55,6 +59,14 @@ inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts.
 template<class C, typename R, typename... Ts, typename... Us>
 inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts...) const, const Us & ... args);
 
+// These versions of wrap_method() take an explicit return-value policy P (see below), e.g.
+//   wrap_method<return_reference_internal> (&X::get_histogram)
+template<typename P, class C, typename R, typename... Ts, typename... Us>
+inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts...), const Us & ... args);
+
+template<typename P, class C, typename R, typename... Ts, typename... Us>
+inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts...) const, const Us & ... args);
+
 // std::function (with 'self' argument) -> python method 
 template<class C, typename R, typename... Ts, typename... Us>
 inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(std::function<R(C*,Ts...)> f, const Us & ... args);
@@ -63,6 +75,27 @@ template<class C, typename... Ts, typename... Us>
 inline std::function<C* (py_object,py_tuple,py_dict)> wrap_constructor(std::function<C* (Ts...)> f, const Us & ... args);
 
 
+// Return-value policies for wrap_method().  The policy is checked at compile time against the
+// return type R of the method.
+//
+//   return_copy                R is a value or reference: the return value is copied into
+//                              a new python object by converter<decay(R)>::to_python().
+//
+//   return_move                R is a value or rvalue reference to an extension type: the
+//                              return value is moved (not copied) into a new python object.
+//
+//   return_reference_internal  R is an lvalue reference or pointer to an extension type (usually
+//                              a data member of 'self'): the returned python object aliases the
+//                              C++ object without copying, and keeps the python 'self' alive.
+//                              A null pointer is returned as None.
+//
+// If no policy is specified, converter<R>::to_python() is used.
+
+struct return_copy { };
+struct return_move { };
+struct return_reference_internal { };
+
+
 // -------------------------------------------------------------------------------------------------
 //
 // Everything after this point is "implementation".
@@ -112,6 +145,53 @@ inline _kwarg<T> kwarg(const std::string &arg_name, const T &default_val)
 }
 
 
+// -------------------------------------------------------------------------------------------------
+//
+// _rv_policy<P,R>: implements return-value policy P for return type R (see return_copy etc. above).
+//
+//   _rv_policy<P,R>::valid                     false if the policy can't be applied to R
+//   _rv_policy<P,R>::to_python(self, ret)      converts return value
+//
+// The return_move and return_reference_internal policies are specialized in pyclops/extension_type.hpp,
+// since they are only defined for extension types.
+
+
+struct _return_default { };
+
+template<typename P, typename R> struct _rv_policy;
+
+template<typename R>
+struct _rv_policy<_return_default, R>
+{
+    static constexpr bool valid = converts_to_python<R>::value;
+
+    template<typename C>
+    static inline py_object to_python(C *self, R &&x) { return converter<R>::to_python(std::forward<R>(x)); }
+};
+
+template<typename R>
+struct _rv_policy<return_copy, R>
+{
+    using U = typename std::decay<R>::type;
+
+    static_assert(!std::is_pointer<U>::value, "return_copy policy: return type must be a value or reference, not a pointer");
+    static_assert(std::is_copy_constructible<U>::value, "return_copy policy: return type must be copy-constructible");
+
+    static constexpr bool valid = converts_to_python<U>::value;
+
+    template<typename C>
+    static inline py_object to_python(C *self, R &&x) { return converter<U>::to_python(x); }
+};
+
+
+// _rv_policy_valid<P,R>: same as _rv_policy<P,R>::valid, but avoids instantiating _rv_policy if R=void.
+template<typename P, typename R>
+struct _rv_policy_valid : std::integral_constant<bool, _rv_policy<P,R>::valid> { };
+
+template<typename P>
+struct _rv_policy_valid<P,void> : std::true_type { };
+
+
 // -------------------------------------------------------------------------------------------------
 //
 // _call_helper
@@ -119,42 +199,52 @@ inline _kwarg<T> kwarg(const std::string &arg_name, const T &default_val)
 // _call_helper<R>::call_func(f, args...) -> py_object
 //     f(args...) -> R -> py_object  [to_python]
 //
-// 
+// _call_helper<R,P>::call_method(c, f, args...) -> py_object
+//     (c->*f)(args...) -> R -> py_object  [return-value policy P]
+//
+// Arguments are perfect-forwarded all the way from the _cargs (see below) to the C++ function.  Since each
+// converted argument is used exactly once, by-value arguments are moved rather than copied.  Similarly,
+// the return value is passed to the to_python converter as an rvalue, so that converters which define
+// to_python(T &&) can move it (see the extension_type converters in pyclops/extension_type.hpp).
+// The end of the C++ call is marked for the per-function call statistics (see pyclops/call_stats.hpp).
+
 
 // Primary template (used for R != void)
-template<typename R> 
+template<typename R, typename P = _return_default>
 struct _call_helper
 {
     template<typename F, typename... Ts>
-    static inline py_object call_func(const F &f, const Ts & ... args)
+    static inline py_object call_func(const F &f, Ts && ... args)
     {
-	return converter<R>::to_python(f(args...));
+	return converter<R>::to_python(_call_stats_mark_body(f(std::forward<Ts>(args)...)));
     }
 
     template<typename C, typename F, typename... Ts>
-    static inline py_object call_method(C *c, const F &f, const Ts & ... args)
+    static inline py_object call_method(C *c, const F &f, Ts && ... args)
     {
 	// Apparently this is the C++ syntax for calling a class member function through a function pointer.
-	return converter<R>::to_python((c->*f)(args...));
+	return _rv_policy<P,R>::to_python(c, _call_stats_mark_body((c->*f)(std::forward<Ts>(args)...)));
     }
 };
 
 
 // Special case: R=void.
-template<>
-struct _call_helper<void>
+template<typename P>
+struct _call_helper<void,P>
 {
     template<typename F, typename... Ts>
-    static inline py_object call_func(const F &f, const Ts & ... args)
+    static inline py_object call_func(const F &f, Ts && ... args)
     {
-	f(args...);
+	f(std::forward<Ts>(args)...);
+	_call_stats_mark(1);
 	return py_object(); // Py_None
     }
 
     template<typename C, typename F, typename... Ts>
-    static inline py_object call_method(C *c, const F &f, const Ts & ... args)
+    static inline py_object call_method(C *c, const F &f, Ts && ... args)
     {
-	(c->*f)(args...);
+	(c->*f)(std::forward<Ts>(args)...);
+	_call_stats_mark(1);
 	return py_object(); // Py_None
     }
 };
@@ -351,6 +441,7 @@ template<typename T>
 struct _carg
 {
     static constexpr bool valid = true;
+    using arg_type = T;
     T arg;
 
     template<typename X>
@@ -417,21 +508,28 @@ struct _cargs_empty {
     { }
 
     template<typename R, typename F, typename... Ts>
-    inline py_object call_func(const F &f, const Ts & ... iargs)
+    inline py_object call_func(const F &f, Ts && ... iargs)
     {
-	return _call_helper<R>::call_func(f, iargs...);
+	return _call_helper<R>::call_func(f, std::forward<Ts>(iargs)...);
     }
     
-    template<typename R, typename C, typename F, typename... Ts>
-    inline py_object call_method(C *c, const F &f, const Ts & ... iargs)
+    template<typename R, typename P, typename C, typename F, typename... Ts>
+    inline py_object call_method(C *c, const F &f, Ts && ... iargs)
     {
-	return _call_helper<R>::call_method(c, f, iargs...);
+	return _call_helper<R,P>::call_method(c, f, std::forward<Ts>(iargs)...);
     }
 
     template<typename C, typename F, typename... Ts>
-    inline C *call_constructor(const F &f, const Ts & ... iargs)
+    inline C *call_constructor(const F &f, Ts && ... iargs)
     {
-	return f(iargs...);
+	return f(std::forward<Ts>(iargs)...);
+    }
+
+    // Calls f without converting the return value (used by wrap_func_async() in pyclops/future.hpp).
+    template<typename R, typename F, typename... Ts>
+    inline R call_raw(const F &f, Ts && ... iargs)
+    {
+	return f(std::forward<Ts>(iargs)...);
     }
 };
 
@@ -451,21 +549,30 @@ struct _cargs_composite {
     { }
     
     template<typename R, typename F, typename... Ts>
-    inline py_object call_func(const F &f, const Ts & ... iargs)
+    inline py_object call_func(const F &f, Ts && ... iargs)
     {
-	return tail.template call_func<R> (f, iargs..., head.arg);
+	return tail.template call_func<R> (f, std::forward<Ts>(iargs)..., std::forward<typename S::arg_type>(head.arg));
     }
 
-    template<typename R, typename C, typename F, typename... Ts>
-    inline py_object call_method(C *c, const F &f, const Ts & ... iargs)
+    template<typename R, typename P, typename C, typename F, typename... Ts>
+    inline py_object call_method(C *c, const F &f, Ts && ... iargs)
     {
-	return tail.template call_method<R> (c, f, iargs..., head.arg);
+	return tail.template call_method<R,P> (c, f, std::forward<Ts>(iargs)..., std::forward<typename S::arg_type>(head.arg));
     }
 
     template<typename C, typename F, typename... Ts>
-    inline C *call_constructor(const F &f, const Ts & ... iargs)
+    inline C *call_constructor(const F &f, Ts && ... iargs)
+    {
+	return tail.template call_constructor<C> (f, std::forward<Ts>(iargs)..., std::forward<typename S::arg_type>(head.arg));
+    }
+
+    // Unlike the other call_*() functions, 'head.arg' is passed as an lvalue, so that by-value
+    // arguments (e.g. shared_ptr<T>) are copied rather than moved.  The owning copy then stays in
+    // the _cargs, which is destroyed with the GIL held (see make_future_state()).
+    template<typename R, typename F, typename... Ts>
+    inline R call_raw(const F &f, Ts && ... iargs)
     {
-	return tail.template call_constructor<C> (f, iargs..., head.arg);
+	return tail.template call_raw<R> (f, std::forward<Ts>(iargs)..., head.arg);
     }
 };
 
@@ -483,7 +590,7 @@ struct _cargs_dummy {
 	throw std::runtime_error("should never be called");
     }
 
-    template<typename R, typename C, typename F>
+    template<typename R, typename P, typename C, typename F>
     inline py_object call_method(C *c, const F &f)
     {
 	throw std::runtime_error("should never be called");
@@ -494,6 +601,12 @@ struct _cargs_dummy {
     {
 	throw std::runtime_error("should never be called");
     }
+
+    template<typename R, typename F>
+    inline R call_raw(const F &f)
+    {
+	throw std::runtime_error("should never be called");
+    }
 };
 
 
@@ -549,6 +662,83 @@ struct _arg_checker
 };
 
 
+// -------------------------------------------------------------------------------------------------
+//
+// Original C++ callables, remembered by wrap_func() and wrap_method() (see find_cpp_callable() in
+// pyclops/cfunction_table.hpp, and pyclops/function_converters.hpp).
+
+
+// Returns a reference to 'x' which can be dropped without holding the GIL.
+inline std::shared_ptr<PyObject> _gil_safe_ref(PyObject *x)
+{
+    Py_INCREF(x);
+
+    return std::shared_ptr<PyObject> (x, [](PyObject *p)
+	{
+	    PyGILState_STATE gstate = PyGILState_Ensure();
+	    Py_DECREF(p);
+	    PyGILState_Release(gstate);
+	});
+}
+
+
+template<typename F> struct _cpp_callable;
+
+template<typename R, typename... Ts>
+struct _cpp_callable<R(Ts...)> : _cpp_callable_base {
+    std::function<R(Ts...)> f;
+
+    _cpp_callable(const std::function<R(Ts...)> &f_) : f(f_) { }
+    virtual const std::type_info &signature() const override { return typeid(R(Ts...)); }
+
+    virtual void (*c_function() const)() override
+    {
+	R (* const *p)(Ts...) = f.template target<R(*)(Ts...)> ();
+	return p ? reinterpret_cast<void (*)()> (*p) : nullptr;
+    }
+};
+
+
+// An unbound method of class C, which becomes a _cpp_callable when bound to an instance.
+template<class C>
+struct _cpp_method_base {
+    virtual ~_cpp_method_base() { }
+
+    // The 'self' reference keeps the instance alive, for the lifetime of the bound callable.
+    virtual std::shared_ptr<_cpp_callable_base> bind(C *p, PyObject *self) const = 0;
+};
+
+template<class C, typename F> struct _cpp_method;
+
+template<class C, typename R, typename... Ts>
+struct _cpp_method<C, R(Ts...)> : _cpp_method_base<C> {
+    std::function<R(C*,Ts...)> f;
+
+    _cpp_method(const std::function<R(C*,Ts...)> &f_) : f(f_) { }
+
+    virtual std::shared_ptr<_cpp_callable_base> bind(C *p, PyObject *self) const override
+    {
+	std::function<R(C*,Ts...)> g = f;
+	std::shared_ptr<PyObject> s = _gil_safe_ref(self);
+	std::function<R(Ts...)> h = [g,p,s](Ts... args) -> R { return g(p, std::forward<Ts>(args)...); };
+	return std::make_shared<_cpp_callable<R(Ts...)>> (h);
+    }
+};
+
+
+// Returned by wrap_method(), analogous to _wrapped_func in pyclops/cfunction_table.hpp.
+template<class C>
+struct _wrapped_method {
+    std::function<py_object(C*,py_tuple,py_dict)> py_func;
+    std::shared_ptr<_cpp_method_base<C>> cpp_func;
+
+    _wrapped_method(const std::function<py_object(C*,py_tuple,py_dict)> &py_func_, const std::shared_ptr<_cpp_method_base<C>> &cpp_func_) :
+	py_func(py_func_), cpp_func(cpp_func_) { }
+
+    py_object operator()(C *self, py_tuple args, py_dict kwds) const { return py_func(self, std::move(args), std::move(kwds)); }
+};
+
+
 // -------------------------------------------------------------------------------------------------
 //
 // "Bottom-line" functional wrappers.
@@ -604,12 +794,13 @@ inline std::function<py_object(py_tuple,py_dict)> wrap_func(std::function<R(Ts..
 	    
 	    // Convert all arguments from python.
 	    cargs_t2 cargs(*x, args, kwds, nargs);
+	    _call_stats_mark(0);
 
 	    // Call function and to_python converter.
 	    return cargs.template call_func<R> (f);
 	};
 
-    return ret;
+    return _wrapped_func(ret, std::make_shared<_cpp_callable<R(Ts...)>> (f));
 }
 
 
@@ -624,6 +815,21 @@ inline std::function<py_object(py_tuple,py_dict)> wrap_func(R (*f)(Ts...), const
 
 template<class C, typename R, typename... Ts, typename... Us>
 inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts...), const Us & ... args)
+{
+    return wrap_method<_return_default> (f, args...);
+}
+
+
+// Need separate version of wrap_method() for const-qualified member functions.
+template<class C, typename R, typename... Ts, typename... Us>
+inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts...) const, const Us & ... args)
+{
+    return wrap_method<_return_default> (f, args...);
+}
+
+
+template<typename P, class C, typename R, typename... Ts, typename... Us>
+inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts...), const Us & ... args)
 {
     using cargs_t = typename _cargs_t<Ts...>::type;
 
@@ -636,7 +842,9 @@ inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts.
 
     using ac = _arg_checker<cargs_t, xargs_t>;
     
-    constexpr bool to_python_error = !std::is_void<R>::value && !converts_to_python<R>::value;
+    static_assert(std::is_same<P,_return_default>::value || !std::is_void<R>::value, "return-value policy was specified for method returning void");
+
+    constexpr bool to_python_error = !_rv_policy_valid<P,R>::value;
     constexpr bool all_checks_passed = ac::valid && !to_python_error;
 
     static_assert(!ac::count_error || (xargs_t::N > 0), "python arguments must be specified (either strings or kwarg(...))");
@@ -670,21 +878,22 @@ inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts.
 	    
 	    // Convert all arguments from python.
 	    cargs_t2 cargs(*x, args, kwds, nargs);
+	    _call_stats_mark(0);
 
 	    // Call method and to_python converter.
-	    return cargs.template call_method<R> (self, f);
+	    return cargs.template call_method<R,P> (self, f);
 	};
 
-    return ret;
+    return _wrapped_method<C> (ret, std::make_shared<_cpp_method<C,R(Ts...)>> (f));
 }
 
 
 // Need separate version of wrap_method() for const-qualified member functions.
-template<class C, typename R, typename... Ts, typename... Us>
+template<typename P, class C, typename R, typename... Ts, typename... Us>
 inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(R (C::*f)(Ts...) const, const Us & ... args)
 {
     using nonconst_t = R (C::*)(Ts...);
-    return wrap_method(nonconst_t(f), args...);
+    return wrap_method<P> (nonconst_t(f), args...);
 }
 
 
@@ -739,12 +948,13 @@ inline std::function<py_object(C*, py_tuple, py_dict)> wrap_method(std::function
 	    
 	    // Convert all arguments from python.
 	    cargs_t2 cargs(*x, args, kwds, nargs);
+	    _call_stats_mark(0);
 
 	    // Call method and to_python converter.
 	    return cargs.template call_func<R> (f, self);
 	};
 
-    return ret;
+    return _wrapped_method<C> (ret, std::make_shared<_cpp_method<C,R(Ts...)>> (f));
 }
 
 
@@ -795,6 +1005,7 @@ inline std::function<C* (py_object,py_tuple,py_dict)> wrap_constructor(std::func
 	    
 	    // Convert all arguments from python.
 	    cargs_t2 cargs(*x, args, kwds, nargs);
+	    _call_stats_mark(0);
 
 	    // Call constructor and return bare pointer.
 	    return cargs.template call_constructor<C> (f);
@@ -0,0 +1,255 @@
+#ifndef _PYCLOPS_FUTURE_HPP
+#define _PYCLOPS_FUTURE_HPP
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include "core.hpp"
+#include "converters.hpp"
+#include "functional_wrappers.hpp"
+#include "intrusive_ptr.hpp"
+#include "thread_pool.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// wrap_func_async(): like wrap_func(), but the C++ function runs on a pyclops worker thread
+// (see pyclops/thread_pool.hpp), and python immediately gets a future object.
+//
+//   m.add_function("fit", "fit model (returns future)", wrap_func_async(fit_model, "data", "niter"));
+//
+//   # python
+//   f = m.fit(data, 1000)
+//   f.add_done_callback(lambda f: log('fit done'))
+//   ...
+//   model = f.result()        # or f.result(timeout=10.0), f.done()
+//
+// Arguments are converted from python when the function is called (with the GIL held), and the
+// python arguments are kept alive until the future is garbage-collected.  The C++ function runs
+// without the GIL, so argument and return types must not be python objects (this is checked with
+// static_assert), and the function must not call into python.
+//
+// The return value is converted to python lazily, by the first call to result().  If the C++ function
+// throws an exception, result() raises it in python.  If result() times out, it raises RuntimeError.
+//
+// Done-callbacks are called with the future as their only argument.  If the future is already done,
+// add_done_callback() calls the callback immediately, otherwise it is called by the worker thread (which
+// acquires the GIL only if callbacks were added).  Exceptions in callbacks are printed and ignored.
+
+
+template<typename R, typename... Ts, typename... Us>
+inline std::function<py_object(py_tuple,py_dict)> wrap_func_async(std::function<R(Ts...)> f, const Us & ... args);
+
+template<typename R, typename... Ts, typename... Us>
+inline std::function<py_object(py_tuple,py_dict)> wrap_func_async(R (*f)(Ts...), const Us & ... args);
+
+
+class completion_queue;   // see pyclops/completion_queue.hpp
+
+
+// State shared between the worker thread and the python future object.
+// Always owned by a shared_ptr (see make_future_state() below).
+struct future_state : std::enable_shared_from_this<future_state> {
+    // Protected by 'lock'.
+    std::mutex lock;
+    std::condition_variable cv;
+    bool done = false;
+    std::exception_ptr error;
+    std::function<py_object()> convert;   // converts the C++ return value, called by result()
+    std::vector<std::shared_ptr<completion_queue>> queues;   // posted to on completion
+
+    // Only accessed with the GIL held (or under 'lock', with the GIL held, for 'callbacks').
+    py_object result;
+    bool converted = false;
+
+    // If converting the return value raised a python exception, the exception is saved here, so that
+    // every call to result() raises it (a NULL value or traceback is saved as None).
+    py_object pyerr_type;
+    py_object pyerr_value;
+    py_object pyerr_traceback;
+    std::vector<py_object> callbacks;
+    py_object self;                       // python future object, held while callbacks are pending
+    py_object queued_self;                // python future object, held until drained from all completion_queues
+    int queued_count = 0;                 // number of completion_queues which haven't drained the future yet
+
+    // Converted C++ arguments, and the python arguments they were converted from.
+    std::shared_ptr<void> cargs;
+    py_object py_args;
+    py_object py_kwds;
+
+    // Called by the worker thread (without the GIL), when the C++ call completes.
+    void set_result(const std::function<py_object()> &convert);
+    void set_exception(std::exception_ptr e);
+
+    // Called with the GIL held, which is released while waiting.
+    // If timeout < 0, waits forever.  Returns false on timeout.
+    bool wait(double timeout);
+
+    // Called with the GIL held, after the future is done.  Rethrows the C++ exception, or returns the
+    // converted return value (which is converted on the first call, and cached).  If conversion raised
+    // a python exception, then the python error indicator is set, and pyerr_occurred is thrown.
+    py_object get_result();
+
+    // Called with the GIL held.  Posts the future to 'q' when it completes (or immediately, if it is
+    // already done).  The python future object 'self' is held until it is drained from the queue.
+    void add_queue(const std::shared_ptr<completion_queue> &q, const py_object &self);
+
+    // Helper for set_result(), set_exception().
+    void _complete();
+
+    // Helpers for get_result(): move the python error indicator to pyerr_*, and restore it from pyerr_*.
+    void _save_pyerr();
+    void _restore_pyerr();
+};
+
+
+// The future_state is destroyed with the GIL held (since it contains python objects), even if the
+// last reference is dropped by a worker thread.  Must be called with the GIL held.
+extern std::shared_ptr<future_state> make_future_state();
+
+// Returns a new python future object (type pyclops.future).
+extern py_object make_python_future(const std::shared_ptr<future_state> &state);
+
+// Throws an exception if 'x' is not a python future object.
+extern std::shared_ptr<future_state> future_state_from_python(const py_object &x, const char *where=NULL);
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+template<typename T>
+struct _is_py_object : std::is_base_of<py_object, typename std::decay<T>::type> { };
+
+// intrusive_ptr<T> counts as a python object here, since its refcount is non-atomic and protected by the GIL.
+template<typename T> struct _is_intrusive_ptr : std::false_type { };
+template<typename T> struct _is_intrusive_ptr<intrusive_ptr<T>> : std::true_type { };
+
+template<typename... Ts> struct _any_py_object;
+
+template<> struct _any_py_object<> : std::false_type { };
+
+template<typename T, typename... Ts>
+struct _any_py_object<T,Ts...> : std::integral_constant<bool, _is_py_object<T>::value || _is_intrusive_ptr<typename std::decay<T>::type>::value || _any_py_object<Ts...>::value> { };
+
+
+// _async_result<R>::run(g): calls g() -> R, and returns a closure which converts the result to python.
+template<typename R>
+struct _async_result {
+    using V = typename std::decay<R>::type;
+
+    template<typename G>
+    static std::function<py_object()> run(const G &g)
+    {
+	std::shared_ptr<V> r = std::make_shared<V> (g());
+	return [r]() { return converter<V>::to_python(std::move(*r)); };
+    }
+};
+
+template<>
+struct _async_result<void> {
+    template<typename G>
+    static std::function<py_object()> run(const G &g)
+    {
+	g();
+	return []() { return py_object(); };  // Py_None
+    }
+};
+
+
+template<typename R, typename... Ts, typename... Us>
+inline std::function<py_object(py_tuple,py_dict)> wrap_func_async(std::function<R(Ts...)> f, const Us & ... args)
+{
+    using cargs_t = typename _cargs_t<Ts...>::type;
+
+    static_assert(!cargs_t::converter_error, "missing from_python converter for at least one function argument");
+
+    using xargs_t = typename _xargs_t<Us...>::type;
+
+    static_assert(!xargs_t::type_error, "all python argument specifiers must be strings or kwarg(...)");
+    static_assert(!xargs_t::ordering_error, "python arguments with default_vals must go at the end");
+
+    using ac = _arg_checker<cargs_t, xargs_t>;
+    using V = typename std::decay<R>::type;
+
+    constexpr bool to_python_error = !std::is_void<R>::value && !converts_to_python<V>::value;
+    constexpr bool all_checks_passed = ac::valid && !to_python_error;
+
+    static_assert(!ac::count_error || (xargs_t::N > 0), "python arguments must be specified (either strings or kwarg(...))");
+    static_assert(!ac::count_error || (xargs_t::N == 0), "number of python argument specifiers doesn't match number of function arguments");
+    static_assert(!ac::convert_error, "type error when converting specified default_val to argument type of C++ function");
+    static_assert(!to_python_error, "missing to_python converter for return value from function");
+    static_assert(!_any_py_object<R,Ts...>::value, "wrap_func_async(): arguments and return value can't be python objects or intrusive_ptrs, since the C++ function runs without the GIL");
+
+    // FIXME memory leaks here (new())
+    xargs_t *x = new xargs_t(args...);
+    argname_hash *a = new argname_hash;
+
+    if (all_checks_passed)
+	x->add_to_argname_hash(*a);
+
+    auto ret = [f,a,x](py_tuple args, py_dict kwds) -> py_object
+	{
+	    constexpr int Nmin = xargs_t::Nmin;
+	    constexpr int Nmax = xargs_t::N;
+
+	    ssize_t nargs = args.size();
+	    ssize_t ntot = nargs + kwds.size();
+
+	    // Quick sanity check on argument count.
+	    if ((ntot < Nmin) || (ntot > Nmax))
+		throw bad_arg_count(ntot, Nmin, Nmax);
+
+	    // Additional checks: invalid keyword args.
+	    a->check(kwds, nargs);
+
+	    using cargs_t2 = typename std::conditional<all_checks_passed, cargs_t, _cargs_dummy>::type;
+
+	    // Convert all arguments from python (with the GIL held).
+	    std::shared_ptr<cargs_t2> cargs = std::make_shared<cargs_t2> (*x, args, kwds, nargs);
+	    _call_stats_mark(0);
+	    cargs_t2 *cp = cargs.get();
+
+	    std::shared_ptr<future_state> state = make_future_state();
+	    state->cargs = cargs;
+	    state->py_args = args;
+	    state->py_kwds = kwds;
+
+	    py_object ret = make_python_future(state);
+
+	    thread_pool::global().submit([f,cp,state]()
+		{
+		    try {
+			state->set_result(_async_result<R>::run([&]() -> R { return cp->template call_raw<R> (f); }));
+		    } catch (...) {
+			state->set_exception(std::current_exception());
+		    }
+		});
+
+	    return ret;
+	};
+
+    return ret;
+}
+
+
+template<typename R, typename... Ts, typename... Us>
+inline std::function<py_object(py_tuple,py_dict)> wrap_func_async(R (*f)(Ts...), const Us & ... args)
+{
+    return wrap_func_async(std::function<R(Ts...)> (f), args...);
+}
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_FUTURE_HPP
@@ -0,0 +1,81 @@
+#ifndef _PYCLOPS_GENERATOR_HPP
+#define _PYCLOPS_GENERATOR_HPP
+
+#include <functional>
+#include "core.hpp"
+#include "converters.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// generator<T>: a resumable C++ producer, which is converted to a python iterator.
+//
+// A generator is constructed from a callback 'bool next(T &x)', which either produces the next item
+// (by assigning to 'x') and returns true, or returns false when the producer is exhausted.  State
+// between calls lives in the callback (e.g. a lambda capturing a shared_ptr to a file reader).
+//
+// A function returning generator<T> can be wrapped with wrap_func() (or wrap_method()) in the usual
+// way, and returns a python iterator.  Each call to next() in python resumes the C++ callback once,
+// and converts one item, so streaming pipelines use constant memory.  For example:
+//
+//   generator<std::string> read_lines(const std::string &filename)
+//   {
+//       auto f = std::make_shared<std::ifstream> (filename);
+//       return generator<std::string> ([f](std::string &line) { return bool(std::getline(*f, line)); });
+//   }
+//
+//   m.add_function("read_lines", "iterate over lines in file", wrap_func(read_lines, "filename"));
+//
+// The callback is destroyed as soon as it returns false (or throws an exception), so that resources
+// such as open files are released before the python iterator is garbage-collected.
+//
+// Note: the element type T must be default-constructible, and must have a to_python converter.
+// (pyclops is C++11, so C++20 coroutine generators are not supported directly, but any coroutine
+// generator can be adapted by a callback which resumes it.)
+
+
+template<typename T>
+struct generator {
+    std::function<bool(T &)> next;
+
+    generator() { }
+    generator(const std::function<bool(T &)> &next_) : next(next_) { }
+};
+
+
+// Analogous to generator<T>, but the item is already converted to python.  Implemented in generator.cpp.
+// Returns a new python iterator object.
+extern py_object make_python_generator(const std::function<bool(py_object &)> &next);
+
+
+template<typename T>
+struct converter<generator<T>> {
+    static py_object to_python(const generator<T> &g)
+    {
+	if (!g.next)
+	    throw std::runtime_error("pyclops: generator<T> to_python converter: empty callback");
+
+	std::function<bool(T &)> f = g.next;
+
+	std::function<bool(py_object &)> pf = [f](py_object &ret) -> bool
+	    {
+		T x;
+		if (!f(x))
+		    return false;
+		ret = converter<T>::to_python(std::move(x));
+		return true;
+	    };
+
+	return make_python_generator(pf);
+    }
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_GENERATOR_HPP
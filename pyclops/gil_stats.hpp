@@ -0,0 +1,248 @@
+#ifndef _PYCLOPS_GIL_STATS_HPP
+#define _PYCLOPS_GIL_STATS_HPP
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include "core.hpp"
+#include "call_stats.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// GIL contention statistics: for each "site", the time spent waiting to acquire the GIL and the
+// time spent holding it, as log2-bucketed histograms (same format as pyclops/call_stats.hpp).
+//
+// Sites are:
+//
+//   - Wrapped functions, methods and constructors (same names as in get_call_stats()).  The hold time
+//     is the duration of the call, minus time spent inside PYCLOPS_BEGIN_ALLOW_THREADS (see below).
+//     The wait time is the time spent reacquiring the GIL at the end of each such block.
+//
+//   - Upcalls through std::function converters (see pyclops/function_converters.hpp), named
+//     "upcall:<__name__>".  These can run on any thread: the wait time is the time spent in
+//     PyGILState_Ensure(), and the hold time is the duration of the python call.
+//
+//   - Upcalls through virtual_function<R> (see pyclops/virtual_function.hpp), named "PyType.method"
+//     where PyType is the type of the python 'self'.  Since these are called with the GIL held,
+//     only the hold time is recorded.
+//
+//   - "future.callbacks", for the add_done_callback() callbacks run by the thread which completes
+//     a future (see pyclops/future.hpp).
+//
+//   - "(other)", for PYCLOPS_BEGIN_ALLOW_THREADS blocks outside any of the above.
+//
+// Collection is off by default, and can be switched on at runtime, or at startup by setting the
+// environment variable PYCLOPS_GIL_STATS=1.  To expose to python:
+//
+//   m.add_function("enable_gil_stats", "turn GIL statistics on/off", wrap_func(enable_gil_stats, "on"));
+//   m.add_function("gil_stats", "returns GIL statistics as a dict", wrap_func(get_gil_stats));
+//   m.add_function("reset_gil_stats", "zeroes GIL statistics", wrap_func(reset_gil_stats));
+//
+//   # python
+//   s = m.gil_stats()['upcall:process']   # { 'nwait': ..., 'wait_ns': ..., 'max_wait_ns': ..., 'wait': [ ... ],
+//                                         #   'nhold': ..., 'hold_ns': ..., 'max_hold_ns': ..., 'hold': [ ... ] }
+//
+// A site with a large wait time is waiting on another thread which holds the GIL: look for the
+// site with a large hold time (usually a wrapped function which should release the GIL).
+//
+// C++ code which releases the GIL should use PYCLOPS_BEGIN_ALLOW_THREADS / PYCLOPS_END_ALLOW_THREADS,
+// which are drop-in replacements for Py_BEGIN_ALLOW_THREADS / Py_END_ALLOW_THREADS.  (Time spent in
+// a Py_BEGIN_ALLOW_THREADS block is counted as hold time for the enclosing call.)
+//
+// Stats are kept per process, and always updated with the GIL held.  As with call_stats, if a wrapped
+// function upcalls into python, the upcall's hold time is also counted in the wrapped function.
+// Sites with the same name (e.g. two modules with a function 'f') are merged.
+
+
+struct gil_stats {
+    static constexpr int nbuckets = 40;    // up to 2^40 ns (~18 minutes)
+
+    const std::string name;
+
+    int64_t nwait = 0;
+    int64_t wait_ns = 0;
+    int64_t max_wait_ns = 0;
+    int64_t nhold = 0;
+    int64_t hold_ns = 0;
+    int64_t max_hold_ns = 0;
+    int64_t wait_histogram[nbuckets];
+    int64_t hold_histogram[nbuckets];
+
+    gil_stats(const std::string &name);
+
+    void add_wait(int64_t dt);
+    void add_hold(int64_t dt);
+    void reset();
+};
+
+
+// Returns the gil_stats with the given name, creating and registering it (never deleted) if needed.
+extern gil_stats *make_gil_stats(const std::string &name);
+
+// Can be wrapped with wrap_func() as shown above.
+extern void enable_gil_stats(bool on);
+extern py_dict get_gil_stats();
+extern void reset_gil_stats();
+
+
+#define PYCLOPS_BEGIN_ALLOW_THREADS  { pyclops::_gil_release_timer _pyclops_gil_timer; Py_BEGIN_ALLOW_THREADS
+#define PYCLOPS_END_ALLOW_THREADS    _pyclops_gil_timer.reacquiring(); Py_END_ALLOW_THREADS _pyclops_gil_timer.reacquired(); }
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+// Read without holding the GIL (e.g. in _gil_upcall_timer), so all accesses are atomic.  Relaxed
+// ordering is sufficient, since the flag doesn't guard any other memory.
+extern std::atomic<bool> _gil_stats_enabled;
+
+// The innermost site on this thread (NULL if none), and the total time this thread has spent
+// in PYCLOPS_BEGIN_ALLOW_THREADS blocks.
+extern thread_local gil_stats *_gil_current;
+extern thread_local int64_t _gil_released_ns;
+
+// Called at the end of PYCLOPS_END_ALLOW_THREADS (t0 = time GIL was released, t1 = time of reacquire request).
+extern void _gil_reacquired(int64_t t0, int64_t t1);
+
+// Site lookup for upcalls (non-inline, since they build names).
+extern gil_stats *_gil_upcall_site(PyObject *f);
+extern gil_stats *_gil_upcall_site(const py_object &self, const char *method_name);
+
+
+// Times the hold time of one call, in the trampolines in cfunction_table.cpp.  The site is saved
+// and restored, so that a nested call doesn't take over the enclosing call's wait time.
+struct _gil_call_timer {
+    gil_stats *stats;
+    gil_stats *saved;
+    int64_t t0 = 0;
+    int64_t released0 = 0;
+
+    _gil_call_timer(gil_stats *stats_) :
+	stats(stats_), saved(_gil_current)
+    {
+	if (!stats)
+	    return;
+
+	_gil_current = stats;
+	released0 = _gil_released_ns;
+	t0 = _call_stats_now();
+    }
+
+    inline void stop()
+    {
+	if (!stats)
+	    return;
+
+	stats->add_hold(_call_stats_now() - t0 - (_gil_released_ns - released0));
+	_gil_current = saved;
+	stats = nullptr;
+    }
+};
+
+
+// Times an upcall.  Construct before acquiring the GIL, call acquired() after acquiring it (or
+// held() if it was already held), and call stop() before releasing it.  Since exceptions can be
+// thrown by an upcall, the destructor also calls stop(), and should run with the GIL held.
+struct _gil_upcall_timer {
+    gil_stats *stats = nullptr;
+    gil_stats *saved = nullptr;
+    int64_t t0 = -1;   // -1 if stats were disabled
+    int64_t t1 = 0;
+    int64_t released0 = 0;
+
+    _gil_upcall_timer()
+    {
+	if (_gil_stats_enabled.load(std::memory_order_relaxed))
+	    t0 = _call_stats_now();
+    }
+
+    ~_gil_upcall_timer() { stop(); }
+
+    inline void _start(gil_stats *s)
+    {
+	stats = s;
+	saved = _gil_current;
+	_gil_current = s;
+	released0 = _gil_released_ns;
+	t1 = _call_stats_now();
+    }
+
+    // After PyGILState_Ensure(): 'f' is the python callable.
+    inline void acquired(PyObject *f)
+    {
+	if (t0 < 0)
+	    return;
+
+	_start(_gil_upcall_site(f));
+	stats->add_wait(t1 - t0);
+    }
+
+    // After PyGILState_Ensure(), for internal sites such as "future.callbacks".
+    inline void acquired(const char *site_name)
+    {
+	if (t0 < 0)
+	    return;
+
+	_start(make_gil_stats(site_name));
+	stats->add_wait(t1 - t0);
+    }
+
+    // For virtual_function upcalls, which are called with the GIL held.
+    inline void held(const py_object &self, const char *method_name)
+    {
+	if (t0 >= 0)
+	    _start(_gil_upcall_site(self, method_name));
+    }
+
+    inline void stop()
+    {
+	if (!stats)
+	    return;
+
+	stats->add_hold(_call_stats_now() - t1 - (_gil_released_ns - released0));
+	_gil_current = saved;
+	stats = nullptr;
+    }
+
+    _gil_upcall_timer(const _gil_upcall_timer &) = delete;
+    _gil_upcall_timer &operator=(const _gil_upcall_timer &) = delete;
+};
+
+
+// Used in PYCLOPS_BEGIN_ALLOW_THREADS / PYCLOPS_END_ALLOW_THREADS.
+struct _gil_release_timer {
+    int64_t t0 = -1;   // -1 if stats were disabled
+    int64_t t1 = 0;
+
+    _gil_release_timer()
+    {
+	if (_gil_stats_enabled.load(std::memory_order_relaxed))
+	    t0 = _call_stats_now();
+    }
+
+    inline void reacquiring()
+    {
+	if (t0 >= 0)
+	    t1 = _call_stats_now();
+    }
+
+    inline void reacquired()
+    {
+	if (t0 >= 0)
+	    _gil_reacquired(t0, t1);
+    }
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_GIL_STATS_HPP
@@ -15,6 +15,7 @@
 #include <iostream>
 
 #include "pyclops/converters.hpp"
+#include "pyclops/record.hpp"
 #include "pyclops/cfunction_table.hpp"
 #include "pyclops/extension_type.hpp"
 #include "pyclops/extension_module.hpp"
@@ -26,10 +27,6 @@ namespace pyclops {
 #endif
 
 
-// This is called whenever we want to "swallow" a C++ exception, but propagate it into the python error indicator.
-extern void set_python_error(const std::exception &e) noexcept;
-
-
 }  // namespace pyclops
 
 #endif  // _PYCLOPS_INTERNALS_HPP
@@ -0,0 +1,170 @@
+#ifndef _PYCLOPS_INTRUSIVE_PTR_HPP
+#define _PYCLOPS_INTRUSIVE_PTR_HPP
+
+#include <utility>
+#include <type_traits>
+#include <sys/types.h>
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// intrusive_ptr<T>: a smart pointer whose reference count lives inside T (in the spirit of boost::intrusive_ptr).
+//
+// This is an alternative to shared_ptr<T> for extension types which are passed between python and C++
+// in hot loops.  Converting an intrusive_ptr<T> to or from python never allocates a shared_ptr control
+// block, and the count is a plain integer rather than an atomic.
+//
+// A type T supports intrusive_ptr<T> if the following functions can be found by argument-dependent
+// lookup (the same hooks as boost::intrusive_ptr):
+//
+//   void intrusive_ptr_add_ref(T *p);
+//   void intrusive_ptr_release(T *p);    // deletes p when the count reaches zero
+//
+// The easiest way to define them is to inherit from intrusive_refcounted<T>:
+//
+//   struct X : pyclops::intrusive_refcounted<X> { ... };
+//
+// If T is an extension_type (see pyclops/extension_type.hpp) with intrusive refcounting, then every
+// python-managed object holds one count, so the C++ object can outlive the python object if C++ code
+// still holds an intrusive_ptr<T>.  The converters are defined in pyclops/extension_type.hpp.
+//
+// Note: intrusive_refcounted<T> is not thread-safe!  Its count should only be modified by threads
+// which hold the GIL (or by a single thread, if the object is never seen by python).
+
+
+template<typename T>
+class intrusive_ptr {
+public:
+    intrusive_ptr() { }
+    intrusive_ptr(T *p, bool add_ref=true);
+    intrusive_ptr(const intrusive_ptr &x);
+    intrusive_ptr(intrusive_ptr &&x);
+    ~intrusive_ptr();
+
+    // Allows intrusive_ptr<Derived> -> intrusive_ptr<Base>.
+    template<typename U, typename = typename std::enable_if<std::is_convertible<U*,T*>::value>::type>
+    intrusive_ptr(const intrusive_ptr<U> &x);
+
+    intrusive_ptr &operator=(const intrusive_ptr &x);
+    intrusive_ptr &operator=(intrusive_ptr &&x);
+
+    inline T *get() const { return ptr; }
+    inline T &operator*() const { return *ptr; }
+    inline T *operator->() const { return ptr; }
+    inline explicit operator bool() const { return ptr != nullptr; }
+
+    inline void reset() { intrusive_ptr().swap(*this); }
+    inline void swap(intrusive_ptr &x) { std::swap(ptr, x.ptr); }
+
+    // Returns the pointer without decrementing the count.
+    inline T *detach() { T *ret = ptr; ptr = nullptr; return ret; }
+
+protected:
+    T *ptr = nullptr;
+};
+
+
+// Analogous to std::make_shared().
+template<typename T, typename... Args>
+inline intrusive_ptr<T> make_intrusive(Args && ... args);
+
+
+// Non-atomic intrusive count (see comment above).
+template<typename T>
+struct intrusive_refcounted {
+    mutable ssize_t pyclops_refcount = 0;
+
+    intrusive_refcounted() { }
+
+    // The count belongs to the object, not its value.
+    intrusive_refcounted(const intrusive_refcounted &) { }
+    intrusive_refcounted &operator=(const intrusive_refcounted &) { return *this; }
+
+    friend inline void intrusive_ptr_add_ref(const T *p)
+    {
+	p->pyclops_refcount++;
+    }
+
+    friend inline void intrusive_ptr_release(const T *p)
+    {
+	if (--p->pyclops_refcount == 0)
+	    delete p;
+    }
+};
+
+
+// has_intrusive_refcount<T>: true if intrusive_ptr_add_ref(T*) and intrusive_ptr_release(T*) exist.
+template<typename T, typename = void>
+struct has_intrusive_refcount : std::false_type { };
+
+template<typename T>
+struct has_intrusive_refcount<T, decltype(intrusive_ptr_add_ref(std::declval<T *>()), intrusive_ptr_release(std::declval<T *>()))> : std::true_type { };
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+template<typename T>
+intrusive_ptr<T>::intrusive_ptr(T *p, bool add_ref) :
+    ptr(p)
+{
+    if (ptr && add_ref)
+	intrusive_ptr_add_ref(ptr);
+}
+
+template<typename T>
+intrusive_ptr<T>::intrusive_ptr(const intrusive_ptr &x) :
+    intrusive_ptr(x.ptr)
+{ }
+
+template<typename T> template<typename U, typename>
+intrusive_ptr<T>::intrusive_ptr(const intrusive_ptr<U> &x) :
+    intrusive_ptr(x.get())
+{ }
+
+template<typename T>
+intrusive_ptr<T>::intrusive_ptr(intrusive_ptr &&x) :
+    ptr(x.ptr)
+{
+    x.ptr = nullptr;
+}
+
+template<typename T>
+intrusive_ptr<T>::~intrusive_ptr()
+{
+    if (ptr)
+	intrusive_ptr_release(ptr);
+}
+
+template<typename T>
+intrusive_ptr<T> &intrusive_ptr<T>::operator=(const intrusive_ptr &x)
+{
+    intrusive_ptr(x).swap(*this);
+    return *this;
+}
+
+template<typename T>
+intrusive_ptr<T> &intrusive_ptr<T>::operator=(intrusive_ptr &&x)
+{
+    intrusive_ptr(std::move(x)).swap(*this);
+    return *this;
+}
+
+
+template<typename T, typename... Args>
+inline intrusive_ptr<T> make_intrusive(Args && ... args)
+{
+    return intrusive_ptr<T> (new T(std::forward<Args>(args)...));
+}
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_INTRUSIVE_PTR_HPP
@@ -0,0 +1,65 @@
+#ifndef _PYCLOPS_PROBES_HPP
+#define _PYCLOPS_PROBES_HPP
+
+// USDT (SystemTap/DTrace-style) static tracepoints, for perf and bpftrace.
+//
+// The probes are compiled in if <sys/sdt.h> is available (on Fedora/CentOS it's in the systemtap-sdt-devel
+// package, on Debian/Ubuntu in systemtap-sdt-dev).  This is a header-only dependency: each probe is a
+// single nop instruction plus a note in the ELF file, so there is no runtime dependency, and no cost
+// beyond computing the probe arguments (which are always cheap) until a tracer is attached.  To compile
+// the probes out, add -DPYCLOPS_NO_USDT to CPP in Makefile.local.
+//
+// All probes use provider name "pyclops":
+//
+//   call_entry(name, nargs)           cfunction_table trampoline entry (functions, methods, constructors).
+//   call_return(name, error)          'name' is the name registered in add_function(), or "Type.method"
+//                                     (see pyclops/call_stats.hpp).  'nargs' is the number of positional
+//                                     args, and 'error' is 1 if an exception was raised.
+//
+//   upcall_entry(method_name, nargs)  virtual_function::upcall() (see pyclops/virtual_function.hpp).
+//   upcall_return(method_name)
+//
+//   array_copy(src, nbytes, typenum)  An array converter had to copy (or cast) its input.  'src' is the
+//                                     input python object, and 'nbytes' is the size of the copy.
+//
+//   hash_table_add(cptr, pptr)        Master hash table updates (C++ pointer -> PyObject *).
+//   hash_table_remove(cptr, pptr)
+//   hash_table_query(cptr, pptr)      'pptr' is the result of the query (NULL if not found).
+//   hash_table_deleter(cptr, pptr)    C++ shared_ptr deleter for a python-managed object.
+//
+//   pyerr_occurred(where, msg)        A pyerr_occurred exception was constructed (see pyclops/core.hpp).
+//                                     'where' may be an empty string.
+//
+// The upcall_* and array_copy probes are in inline code, so they are compiled into the extension
+// module which uses them, rather than libpyclops.so.  Examples:
+//
+//   bpftrace -e 'usdt:./libpyclops.so:pyclops:call_entry { @[str(arg0)] = count(); }'
+//   bpftrace -e 'usdt:./my_module.so:pyclops:array_copy { @bytes = hist(arg1); }'
+//
+//   perf buildid-cache --add ./libpyclops.so
+//   perf probe sdt_pyclops:pyerr_occurred
+//   perf record -e sdt_pyclops:pyerr_occurred -a
+
+
+#ifndef PYCLOPS_NO_USDT
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PYCLOPS_HAVE_USDT 1
+#endif
+#endif
+#endif
+
+
+#ifdef PYCLOPS_HAVE_USDT
+#define PYCLOPS_PROBE1(name, a1)          DTRACE_PROBE1(pyclops, name, a1)
+#define PYCLOPS_PROBE2(name, a1, a2)      DTRACE_PROBE2(pyclops, name, a1, a2)
+#define PYCLOPS_PROBE3(name, a1, a2, a3)  DTRACE_PROBE3(pyclops, name, a1, a2, a3)
+#else
+#define PYCLOPS_PROBE1(name, a1)          do { } while (0)
+#define PYCLOPS_PROBE2(name, a1, a2)      do { } while (0)
+#define PYCLOPS_PROBE3(name, a1, a2, a3)  do { } while (0)
+#endif
+
+
+#endif  // _PYCLOPS_PROBES_HPP
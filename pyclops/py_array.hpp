@@ -3,6 +3,7 @@
 
 #include <complex>
 #include "core.hpp"
+#include "probes.hpp"
 
 
 namespace pyclops {
@@ -35,10 +36,17 @@ struct py_array : public py_object {
     // Note that the 'type' argument can be npy_type<T>::id.
     static inline py_array make(int ndim, const npy_intp *shape, int type);
 
+    // This version of make() takes a dtype, and steals the reference to 'desc' (following PyArray_NewFromDescr()).
+    // Note that the 'desc' argument can be npy_dtype<T>::make().
+    static inline py_array make(int ndim, const npy_intp *shape, PyArray_Descr *desc);
+
     // The 'req' argument is a bitwise-or of required numpy flags (see below for list of all flags).
     // If 'min_ndim' and/or 'max_ndim' arguments are zero, they will be ignored.
     static inline py_array from_sequence(const py_object &seq, int type, int req, int min_ndim=0, int max_ndim=0);
 
+    // This version of from_sequence() takes a dtype, and steals the reference to 'desc' (following PyArray_FromAny()).
+    static inline py_array from_sequence(const py_object &seq, PyArray_Descr *desc, int req, int min_ndim=0, int max_ndim=0);
+
     // Two versions of py_array::from_pointer(), with and without a base object.
     // Reminder: following numpy conventions, the strides should include a factor of 'itemsize'!
 
@@ -121,10 +129,13 @@ struct npy_type<const T, 0>
 
 // Specific types follow.
 template<> struct npy_type<char,0> { static constexpr int id = NPY_BYTE; };
+template<> struct npy_type<signed char,0> { static constexpr int id = NPY_BYTE; };
+template<> struct npy_type<short,0> { static constexpr int id = NPY_SHORT; };
 template<> struct npy_type<int,0> { static constexpr int id = NPY_INT; };
 template<> struct npy_type<long,0> { static constexpr int id = NPY_LONG; };
 template<> struct npy_type<long long,0> { static constexpr int id = NPY_LONGLONG; };
 template<> struct npy_type<unsigned char,0> { static constexpr int id = NPY_UBYTE; };
+template<> struct npy_type<unsigned short,0> { static constexpr int id = NPY_USHORT; };
 template<> struct npy_type<unsigned int,0> { static constexpr int id = NPY_UINT; };
 template<> struct npy_type<unsigned long,0> { static constexpr int id = NPY_ULONG; };
 template<> struct npy_type<unsigned long long,0> { static constexpr int id = NPY_ULONGLONG; };
@@ -136,6 +147,35 @@ template<> struct npy_type<std::complex<double>,0> { static constexpr int id = N
 template<> struct npy_type<std::complex<long double>,0>  { static constexpr int id = NPY_CLONGDOUBLE; };
 
 
+// -------------------------------------------------------------------------------------------------
+//
+// npy_dtype<T>: generalizes npy_type<T> to types which are described by a numpy dtype object,
+// rather than a typenum (e.g. structured dtypes, see pyclops/record.hpp).
+//
+//   npy_dtype<T>::make()       returns new reference to the dtype (PyArray_Descr *), never NULL
+//   npy_dtype<T>::matches(a)   returns true if array 'a' has the dtype corresponding to T
+//
+// The primary template is defined in terms of npy_type<T>.
+
+
+template<typename T, typename = void>
+struct npy_dtype {
+    static inline PyArray_Descr *make()
+    {
+	PyArray_Descr *desc = PyArray_DescrFromType(npy_type<T>::id);
+	if (!desc)
+	    throw pyerr_occurred("pyclops::npy_dtype::make()");
+	return desc;
+    }
+
+    static inline bool matches(const py_array &a) { return a.type() == npy_type<T>::id; }
+};
+
+// Handle 'const T'.
+template<typename T>
+struct npy_dtype<const T> : npy_dtype<T> { };
+
+
 // -------------------------------------------------------------------------------------------------
 //
 // Implementation.
@@ -207,17 +247,36 @@ inline py_array py_array::make(int ndim, const npy_intp *shape, int type)
 }
 
 
-inline py_array py_array::from_sequence(const py_object &seq, int type, int requirements, int min_ndim, int max_ndim)
+inline py_array py_array::make(int ndim, const npy_intp *shape, PyArray_Descr *desc)
 {
-    // Make sure the returned array is a base-class ndarray.
-    requirements |= NPY_ARRAY_ENSUREARRAY;
+    PyObject *p = PyArray_NewFromDescr(&PyArray_Type, desc, ndim, const_cast<npy_intp *> (shape), NULL, NULL, 0, NULL);
+    return py_array::new_reference(p);
+}
 
-    // FIXME figure out whether I need to decrement the refcount.
+
+inline py_array py_array::from_sequence(const py_object &seq, int type, int requirements, int min_ndim, int max_ndim)
+{
+    // Note: PyArray_DescrFromType() returns a new reference, which is stolen by PyArray_FromAny().
     PyArray_Descr *desc = PyArray_DescrFromType(type);
     if (!desc)
 	throw pyerr_occurred("py_array::from_sequence()");
 
+    return from_sequence(seq, desc, requirements, min_ndim, max_ndim);
+}
+
+
+inline py_array py_array::from_sequence(const py_object &seq, PyArray_Descr *desc, int requirements, int min_ndim, int max_ndim)
+{
+    // Make sure the returned array is a base-class ndarray.
+    requirements |= NPY_ARRAY_ENSUREARRAY;
+
     PyObject *p = PyArray_FromAny(seq.ptr, desc, min_ndim, max_ndim, requirements, NULL);
+
+    // PyArray_FromAny() returns its input (with a new reference) if no copy was needed.  An ndarray
+    // subclass comes back as a base-class view (because of NPY_ARRAY_ENSUREARRAY), which doesn't own its data.
+    if (p && (p != seq.ptr) && PyArray_CHKFLAGS((PyArrayObject *) p, NPY_ARRAY_OWNDATA))
+	PYCLOPS_PROBE3(array_copy, seq.ptr, (long) PyArray_NBYTES((PyArrayObject *) p), PyArray_TYPE((PyArrayObject *) p));
+
     return py_array::new_reference(p);
 }
 
@@ -0,0 +1,262 @@
+#ifndef _PYCLOPS_RECORD_HPP
+#define _PYCLOPS_RECORD_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <type_traits>
+
+#include "core.hpp"
+#include "py_array.hpp"
+#include "py_list.hpp"
+#include "converters.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Structured numpy dtypes for C++ POD structs ("record arrays").
+//
+// To map a C++ struct to a numpy structured dtype, specialize record<T> and list its fields:
+//
+//   struct Event { double time; float dm; float snr; int beam_id; };
+//
+//   namespace pyclops {
+//       template<> struct record<Event> {
+//           static void fields(record_fields<Event> &f)
+//           {
+//               f.add("time", &Event::time);
+//               f.add("dm", &Event::dm);
+//               f.add("snr", &Event::snr);
+//               f.add("beam_id", &Event::beam_id);
+//           }
+//       };
+//   }
+//
+// The field types are determined at compile time from the member pointers, and can be any type
+// with an npy_type<> (e.g. arithmetic or complex types), or another record type.  Byte offsets
+// are taken from the C++ struct layout, and the dtype itemsize is sizeof(T), so that any padding
+// is preserved.  Fields which are not listed are treated as padding.
+//
+// Once record<T> is defined, the following work with zero per-element conversion:
+//
+//   - in_array<Event>, io_array<Event> and friends (see pyclops/array_converters.hpp)
+//   - std::vector<Event> converts to/from a 1-d structured ndarray (via memcpy)
+//
+// The dtype is constructed once (on first use) and cached.
+
+
+template<typename T> struct record;    // specialized by user, see above
+template<typename T> struct record_fields;
+
+
+// has_record<T>: true if record<T> has been specialized.
+template<typename T, typename = void>
+struct has_record : std::false_type { };
+
+template<typename T>
+struct has_record<T, decltype(record<T>::fields(std::declval<record_fields<T> &>()))> : std::true_type { };
+
+
+// Runtime description of one field (also used by soa_array<T>, see pyclops/soa_array.hpp).
+struct record_field {
+    std::string name;
+    npy_intp offset;     // byte offset within T
+    npy_intp itemsize;   // sizeof(U)
+    py_object dtype;     // PyArray_Descr
+};
+
+
+template<typename T>
+struct record_fields {
+    static_assert(std::is_standard_layout<T>::value, "pyclops::record<T>: T must be a standard-layout type");
+    static_assert(std::is_trivially_copyable<T>::value, "pyclops::record<T>: T must be trivially copyable");
+
+    std::vector<record_field> fields;
+
+    template<typename U>
+    inline void add(const char *name, U T::*member);
+
+    // Returns index in 'fields' of the specified member (throws exception if not found).
+    template<typename U>
+    inline int index_of(U T::*member) const;
+};
+
+
+// Returns the cached list of fields (constructed on first call).
+template<typename T>
+inline const record_fields<T> &record_layout();
+
+// Returns borrowed reference to the cached dtype (never NULL).
+template<typename T>
+inline PyArray_Descr *record_dtype();
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+// Returns the byte offset of a data member, using uninitialized (but correctly aligned) storage.
+template<typename T, typename U>
+inline npy_intp _member_offset(U T::*member)
+{
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type buf;
+    const T *tp = reinterpret_cast<const T *> (&buf);
+    return reinterpret_cast<const char *> (&(tp->*member)) - reinterpret_cast<const char *> (tp);
+}
+
+
+template<typename T> template<typename U>
+inline void record_fields<T>::add(const char *name, U T::*member)
+{
+    record_field f;
+    f.name = name;
+    f.offset = _member_offset(member);
+    f.itemsize = sizeof(U);
+
+    // The PyArray_Descr is a python object, and py_object takes ownership of the new reference.
+    f.dtype = py_object::new_reference(reinterpret_cast<PyObject *> (npy_dtype<U>::make()));
+
+    fields.push_back(f);
+}
+
+
+template<typename T> template<typename U>
+inline int record_fields<T>::index_of(U T::*member) const
+{
+    npy_intp offset = _member_offset(member);
+
+    for (unsigned int i = 0; i < fields.size(); i++)
+	if ((fields[i].offset == offset) && (fields[i].itemsize == sizeof(U)))
+	    return i;
+
+    throw std::runtime_error("pyclops::record_fields::index_of(): member was not listed in record<T>::fields()");
+}
+
+
+template<typename T>
+inline record_fields<T> *_make_record_fields()
+{
+    // Deleted if record<T>::fields() throws.
+    std::unique_ptr<record_fields<T>> ret(new record_fields<T> ());
+    record<T>::fields(*ret);
+    return ret.release();
+}
+
+
+template<typename T>
+inline const record_fields<T> &record_layout()
+{
+    // Note: the cached object is never deleted (it holds python references).
+    static record_fields<T> *ret = _make_record_fields<T> ();
+    return *ret;
+}
+
+
+template<typename T>
+inline PyArray_Descr *_make_record_dtype()
+{
+    const std::vector<record_field> &fields = record_layout<T>().fields;
+
+    py_list names;
+    py_list formats;
+    py_list offsets;
+
+    for (const record_field &f: fields) {
+	names.append(converter<std::string>::to_python(f.name));
+	formats.append(f.dtype);
+	offsets.append(converter<npy_intp>::to_python(f.offset));
+    }
+
+    // Equivalent to numpy.dtype({'names': [...], 'formats': [...], 'offsets': [...], 'itemsize': sizeof(T)})
+    py_dict d;
+    d.set_item("names", names);
+    d.set_item("formats", formats);
+    d.set_item("offsets", offsets);
+    d.set_item("itemsize", converter<npy_intp>::to_python(sizeof(T)));
+
+    PyArray_Descr *ret = nullptr;
+    if (!PyArray_DescrConverter(d.ptr, &ret) || !ret)
+	throw pyerr_occurred("pyclops::record_dtype()");
+
+    if (ret->elsize != (int)sizeof(T))
+	throw std::runtime_error("pyclops::record_dtype(): numpy dtype itemsize does not match sizeof(T)");
+
+    return ret;
+}
+
+
+template<typename T>
+inline PyArray_Descr *record_dtype()
+{
+    // Note: the cached reference is never released.
+    static PyArray_Descr *ret = _make_record_dtype<T> ();
+    return ret;
+}
+
+
+// npy_dtype<T> specialization for record types (primary template is in pyclops/py_array.hpp).
+template<typename T>
+struct npy_dtype<T, typename std::enable_if<has_record<T>::value>::type> {
+    static inline PyArray_Descr *make()
+    {
+	PyArray_Descr *ret = record_dtype<T> ();
+	Py_INCREF(ret);
+	return ret;
+    }
+
+    static inline bool matches(const py_array &a)
+    {
+	PyArray_Descr *desc = PyArray_DESCR(a.aptr());
+	return (desc == record_dtype<T>()) || PyArray_EquivTypes(desc, record_dtype<T>());
+    }
+};
+
+
+// std::vector<T> converter for record types.  In both directions, the data is copied with a single
+// memcpy(), with no per-element conversion.  The python object is a 1-d structured ndarray.
+
+template<typename T>
+struct predicated_converter<std::vector<T>, typename std::enable_if<has_record<T>::value>::type>
+{
+    static inline std::vector<T> from_python(const py_object &x, const char *where=nullptr)
+    {
+	std::vector<T> ret;
+	assign_from_python(ret, x, where);
+	return ret;
+    }
+
+    // In-place version: resizes 'dst' (reusing its capacity) and copies with a single memcpy().
+    static inline void assign_from_python(std::vector<T> &dst, const py_object &x, const char *where=nullptr)
+    {
+	int flags = NPY_ARRAY_NOTSWAPPED | NPY_ARRAY_ALIGNED | NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_FORCECAST;
+	py_array a = py_array::from_sequence(x, npy_dtype<T>::make(), flags, 1, 1);
+
+	npy_intp n = a.shape(0);
+	dst.resize(n);
+
+	if (n > 0)
+	    memcpy(&dst[0], a.data(), n * sizeof(T));
+    }
+
+    static inline py_object to_python(const std::vector<T> &x)
+    {
+	npy_intp n = x.size();
+	py_array ret = py_array::make(1, &n, npy_dtype<T>::make());
+
+	if (n > 0)
+	    memcpy(ret.data(), &x[0], n * sizeof(T));
+	return ret;
+    }
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_RECORD_HPP
@@ -0,0 +1,216 @@
+#ifndef _PYCLOPS_SOA_ARRAY_HPP
+#define _PYCLOPS_SOA_ARRAY_HPP
+
+#include <vector>
+#include "core.hpp"
+#include "py_array.hpp"
+#include "record.hpp"
+#include "extension_type.hpp"
+#include "functional_wrappers.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// soa_array<T>: a container of N records of type T, stored in "struct-of-arrays" layout.
+//
+// The type T must have a record<T> specialization (see pyclops/record.hpp), which lists the fields.
+// Each field is stored as a separate contiguous C++ array, so that C++ kernels get cache-friendly
+// columnar scans:
+//
+//   soa_array<Event> events(n);
+//   float *dm = events.column(&Event::dm);
+//   for (ssize_t i = 0; i < events.size(); i++)
+//       dm[i] *= 2.0;
+//
+// The container is exposed to python by wrap_soa_array(), which populates an extension_type:
+//
+//   static extension_type<soa_array<Event>> Events_type("Events", "Columnar event catalog");
+//   wrap_soa_array(Events_type);
+//   m.add_type(Events_type);
+//
+// In python, each field appears as a property which returns a zero-copy writeable numpy array
+// (the array holds a reference to the container), and events[i] returns a lightweight proxy
+// whose attributes read and write the i-th element of each column.  No per-record python
+// objects are created unless python asks for them.
+//
+// The number of records is fixed at construction, so that numpy views are never invalidated.
+
+
+// Non-template base class, so that the per-record proxy type can be implemented in soa_array.cpp.
+struct _soa_base {
+    ssize_t nrecords = 0;
+    std::vector<char *> columns;
+    const std::vector<record_field> *fields = nullptr;   // owned by record_layout<T>()
+
+    _soa_base(ssize_t nrecords, const std::vector<record_field> &fields);
+    ~_soa_base();
+
+    // Noncopyable, since numpy views may point into the columns.
+    _soa_base(const _soa_base &) = delete;
+    _soa_base &operator=(const _soa_base &) = delete;
+
+    inline ssize_t size() const { return nrecords; }
+
+    // Returns field index, or -1 if not found.
+    int field_index(const char *name) const;
+
+    // Returns zero-copy 1-d view of column j.  The 'base' object is kept alive by the view.
+    py_array column_view(int j, const py_object &base) const;
+
+    // Returns zero-copy 0-d view of element i of column j.
+    py_array element_view(int j, ssize_t i, const py_object &base) const;
+
+    // Returns the proxy object for record i (negative indices count from the end).
+    py_object get_proxy(const py_object &self, ssize_t i);
+};
+
+
+template<typename T>
+struct soa_array : _soa_base {
+    explicit soa_array(ssize_t nrecords);
+
+    // Returns pointer to the contiguous column for the specified member, e.g. column(&Event::dm).
+    template<typename U> inline U *column(U T::*member);
+    template<typename U> inline const U *column(U T::*member) const;
+
+    // Gather/scatter a single record.
+    inline T get(ssize_t i) const;
+    inline void set(ssize_t i, const T &x);
+};
+
+
+template<typename T>
+inline void wrap_soa_array(extension_type<soa_array<T>> &type);
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+template<typename T>
+soa_array<T>::soa_array(ssize_t nrecords_) :
+    _soa_base(nrecords_, record_layout<T>().fields)
+{ }
+
+
+template<typename T> template<typename U>
+inline U *soa_array<T>::column(U T::*member)
+{
+    int j = record_layout<T>().index_of(member);
+    return reinterpret_cast<U *> (columns[j]);
+}
+
+
+template<typename T> template<typename U>
+inline const U *soa_array<T>::column(U T::*member) const
+{
+    int j = record_layout<T>().index_of(member);
+    return reinterpret_cast<const U *> (columns[j]);
+}
+
+
+template<typename T>
+inline T soa_array<T>::get(ssize_t i) const
+{
+    T ret;
+    char *dst = reinterpret_cast<char *> (&ret);
+    memset(dst, 0, sizeof(T));   // zero any padding or unlisted fields
+
+    for (unsigned int j = 0; j < fields->size(); j++) {
+	const record_field &f = (*fields)[j];
+	memcpy(dst + f.offset, columns[j] + i * f.itemsize, f.itemsize);
+    }
+
+    return ret;
+}
+
+
+template<typename T>
+inline void soa_array<T>::set(ssize_t i, const T &x)
+{
+    const char *src = reinterpret_cast<const char *> (&x);
+
+    for (unsigned int j = 0; j < fields->size(); j++) {
+	const record_field &f = (*fields)[j];
+	memcpy(columns[j] + i * f.itemsize, src + f.offset, f.itemsize);
+    }
+}
+
+
+// Helpers for wrap_soa_array(): the mapping slots.  Since T is a template parameter,
+// these don't need a cfunction_table.
+
+template<typename T>
+static Py_ssize_t _soa_mp_length(PyObject *self)
+{
+    auto *wp = reinterpret_cast<class_wrapper<soa_array<T>> *> (self);
+    if (!wp->p) {
+	PyErr_SetString(PyExc_RuntimeError, "pyclops: soa_array.__init__() was never called?!");
+	return -1;
+    }
+    return wp->p->size();
+}
+
+
+template<typename T>
+static PyObject *_soa_mp_subscript(PyObject *self, PyObject *key)
+{
+    try {
+	auto *wp = reinterpret_cast<class_wrapper<soa_array<T>> *> (self);
+	if (!wp->p)
+	    throw std::runtime_error("pyclops: soa_array.__init__() was never called?!");
+
+	ssize_t i = converter<ssize_t>::from_python(py_object::borrowed_reference(key), "soa_array.__getitem__");
+	py_object ret = wp->p->get_proxy(py_object::borrowed_reference(self), i);
+
+	PyObject *p = ret.ptr;
+	ret.ptr = NULL;  // steal reference
+	return p;
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    } catch (...) {
+	PyErr_SetString(PyExc_RuntimeError, "C++ exception was thrown, but not a subclass of std::exception");
+	return NULL;
+    }
+}
+
+
+template<typename T>
+inline void wrap_soa_array(extension_type<soa_array<T>> &type)
+{
+    std::function<soa_array<T>* (ssize_t)> f_init = [](ssize_t n) { return new soa_array<T> (n); };
+    type.add_constructor(wrap_constructor(f_init, "n"));
+
+    PyTypeObject *tp = type.tobj;
+    const std::vector<record_field> &fields = record_layout<T>().fields;
+
+    for (unsigned int j = 0; j < fields.size(); j++) {
+	std::function<py_object(py_object)> f_get = [tp,j](py_object self) -> py_object
+	    {
+		soa_array<T> *s = extension_type<soa_array<T>>::bare_pointer_from_python(tp, self);
+		return s->column_view(j, self);
+	    };
+
+	type.add_property(fields[j].name, "zero-copy view of field '" + fields[j].name + "'", f_get);
+    }
+
+    // FIXME memory leak (never freed, but only allocated once per type).
+    PyMappingMethods *mp = new PyMappingMethods;
+    memset(mp, 0, sizeof(PyMappingMethods));
+    mp->mp_length = _soa_mp_length<T>;
+    mp->mp_subscript = _soa_mp_subscript<T>;
+    tp->tp_as_mapping = mp;
+}
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_SOA_ARRAY_HPP
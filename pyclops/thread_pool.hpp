@@ -0,0 +1,56 @@
+#ifndef _PYCLOPS_THREAD_POOL_HPP
+#define _PYCLOPS_THREAD_POOL_HPP
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// thread_pool: fixed-size pool of worker threads with a FIFO task queue, used by wrap_func_async()
+// (see pyclops/future.hpp).
+//
+// Tasks run without the GIL, and must not call into python.  A task which throws an exception
+// terminates the process, so tasks should catch their own exceptions (wrap_func_async() stores them
+// in the future).
+
+
+class thread_pool {
+public:
+    explicit thread_pool(int nthreads);
+
+    // Waits for queued tasks to finish, then joins all threads.
+    ~thread_pool();
+
+    void submit(const std::function<void()> &task);
+
+    int num_threads() const { return threads.size(); }
+
+    // The pool used by wrap_func_async().  Created on first use, with one thread per core (or the
+    // value of the environment variable PYCLOPS_NUM_THREADS, if defined).  Never destroyed, since
+    // worker threads may still be running when static destructors are called.
+    static thread_pool &global();
+
+protected:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void worker_main();
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_THREAD_POOL_HPP
@@ -0,0 +1,351 @@
+#ifndef _PYCLOPS_THREADED_GENERATOR_HPP
+#define _PYCLOPS_THREADED_GENERATOR_HPP
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include "core.hpp"
+#include "converters.hpp"
+#include "array_converters.hpp"
+#include "generator.hpp"
+#include "gil_stats.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// threaded_generator<T>: like generator<T> (see pyclops/generator.hpp), but the C++ producer runs
+// on a background thread, which reads ahead into a bounded queue.
+//
+// This is intended for I/O-bound producers (e.g. reading and decompressing files), so that the
+// producer runs concurrently with python-side processing of earlier items.  The background thread
+// never touches the python interpreter, and the python side only holds the GIL while converting
+// items (the GIL is released while waiting for the producer).
+//
+//   threaded_generator<float> read_samples(const std::string &filename)
+//   {
+//       auto r = std::make_shared<sample_reader> (filename);
+//       return threaded_generator<float> ([r](float &x) { return r->next(x); },
+//                                         64,       // depth: max number of queued items (or chunks)
+//                                         65536);   // chunk_size: python iterator yields numpy arrays
+//   }
+//
+// If chunk_size is zero, the python iterator yields one converted item at a time.  If chunk_size is
+// nonzero, the background thread accumulates chunks of 'chunk_size' items, and the python iterator
+// yields each chunk converted by the std::vector<T> converter (i.e. a 1-d numpy array, if T is an
+// arithmetic, complex, or record type).  The last chunk may be shorter.
+//
+// Backpressure: when 'depth' items (or chunks) are queued, the producer blocks until python consumes
+// one.  If the python iterator is garbage-collected before the producer is exhausted, the producer
+// is stopped after its current item, and the background thread is joined.
+//
+// If the producer throws an exception, the exception is rethrown in python after all previously
+// produced items have been consumed.
+//
+// Note: the producer callback is called on the background thread, so it must not call into python.
+
+
+template<typename T>
+struct threaded_generator {
+    std::function<bool(T &)> next;
+    ssize_t depth = 16;
+    ssize_t chunk_size = 0;
+
+    threaded_generator() { }
+    threaded_generator(const std::function<bool(T &)> &next_, ssize_t depth_=16, ssize_t chunk_size_=0) :
+	next(next_), depth(depth_), chunk_size(chunk_size_) { }
+};
+
+
+// prefetch_queue<T>: bounded single-producer, single-consumer queue, used by threaded_generator<T>.
+//
+// The fast path (queue neither full nor empty) is lock-free: a ring buffer with atomic head/tail
+// counters.  The mutex and condition variable are only used when the producer or consumer needs
+// to sleep (queue full or empty), or on close() and cancel().
+
+template<typename T>
+class prefetch_queue {
+public:
+    explicit prefetch_queue(ssize_t capacity);
+
+    // Called by producer thread.  Blocks if the queue is full.  Returns false if cancel() has been called.
+    inline bool push(T &&x);
+
+    // Called by producer thread, after the last push().  The optional exception is rethrown by pop().
+    inline void close(std::exception_ptr e = std::exception_ptr());
+
+    // Called by consumer thread (with the GIL held).  Blocks if the queue is empty, releasing the GIL.
+    // Returns false if the queue has been closed, and all items have been consumed.
+    inline bool pop(T &x);
+
+    // Called by consumer thread.  Wakes the producer, and causes subsequent calls to push() to return false.
+    inline void cancel();
+
+protected:
+    const size_t capacity;
+    std::vector<T> slots;
+
+    std::atomic<size_t> head;   // number of items popped
+    std::atomic<size_t> tail;   // number of items pushed
+    std::atomic<bool> closed;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> producer_waiting;
+    std::atomic<bool> consumer_waiting;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::exception_ptr error;   // protected by lock
+
+    inline void _wake();
+};
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+template<typename T>
+prefetch_queue<T>::prefetch_queue(ssize_t capacity_) :
+    capacity(capacity_),
+    slots(capacity_ > 0 ? capacity_ : 0),
+    head(0), tail(0), closed(false), cancelled(false), producer_waiting(false), consumer_waiting(false)
+{
+    if (capacity_ <= 0)
+	throw std::runtime_error("pyclops::prefetch_queue: capacity must be positive");
+}
+
+
+template<typename T>
+inline void prefetch_queue<T>::_wake()
+{
+    // Taking the lock before notifying ensures that the waiting thread is either inside cv.wait(),
+    // or has not yet evaluated its predicate (see comments in push() and pop()).
+    std::lock_guard<std::mutex> l(lock);
+    cv.notify_all();
+}
+
+
+template<typename T>
+inline bool prefetch_queue<T>::push(T &&x)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+
+    if (t - head.load() >= capacity) {
+	std::unique_lock<std::mutex> l(lock);
+	producer_waiting = true;
+	cv.wait(l, [&] { return (t - head.load() < capacity) || cancelled.load(); });
+	producer_waiting = false;
+    }
+
+    if (cancelled.load())
+	return false;
+
+    slots[t % capacity] = std::move(x);
+
+    // The (seq_cst) store to 'tail' followed by the load of 'consumer_waiting' pairs with the opposite
+    // order in pop(), so that at least one side observes the other, and no wakeup is lost.
+    tail.store(t+1);
+
+    if (consumer_waiting.load())
+	_wake();
+
+    return true;
+}
+
+
+template<typename T>
+inline void prefetch_queue<T>::close(std::exception_ptr e)
+{
+    {
+	std::lock_guard<std::mutex> l(lock);
+	error = e;
+	closed = true;
+    }
+    cv.notify_all();
+}
+
+
+template<typename T>
+inline bool prefetch_queue<T>::pop(T &x)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+
+    if (h == tail.load()) {
+	// Slow path: release the GIL while waiting for the producer.
+	PYCLOPS_BEGIN_ALLOW_THREADS
+	{
+	    std::unique_lock<std::mutex> l(lock);
+	    consumer_waiting = true;
+	    cv.wait(l, [&] { return (h != tail.load()) || closed.load(); });
+	    consumer_waiting = false;
+	}  // release lock before reacquiring GIL
+	PYCLOPS_END_ALLOW_THREADS
+    }
+
+    if (h == tail.load()) {
+	// Queue is closed and drained.
+	std::exception_ptr e;
+	{
+	    std::lock_guard<std::mutex> l(lock);
+	    std::swap(e, error);   // rethrow only once
+	}
+	if (e)
+	    std::rethrow_exception(e);
+	return false;
+    }
+
+    x = std::move(slots[h % capacity]);
+    head.store(h+1);
+
+    if (producer_waiting.load())
+	_wake();
+
+    return true;
+}
+
+
+template<typename T>
+inline void prefetch_queue<T>::cancel()
+{
+    {
+	std::lock_guard<std::mutex> l(lock);
+	cancelled = true;
+    }
+    cv.notify_all();
+}
+
+
+// Shared state between the background thread and the python iterator.  The background thread
+// only has a bare pointer, which is safe since the destructor joins the thread.
+
+template<typename Q>
+struct _threaded_producer {
+    prefetch_queue<Q> queue;
+    std::thread thread;
+
+    _threaded_producer(ssize_t depth) : queue(depth) { }
+
+    ~_threaded_producer()
+    {
+	queue.cancel();
+
+	// The destructor is called with the GIL held (by the python iterator), so we release it while
+	// joining, in case the producer is in the middle of a slow operation.
+	if (thread.joinable()) {
+	    PYCLOPS_BEGIN_ALLOW_THREADS
+	    thread.join();
+	    PYCLOPS_END_ALLOW_THREADS
+	}
+    }
+};
+
+
+// Helper for converter<threaded_generator<T>>: starts background thread, returns python iterator.
+template<typename Q>
+inline py_object _start_threaded_producer(ssize_t depth, const std::function<void(prefetch_queue<Q> &)> &run)
+{
+    auto state = std::make_shared<_threaded_producer<Q>> (depth);
+    _threaded_producer<Q> *sp = state.get();
+
+    state->thread = std::thread([sp,run]()
+	{
+	    try {
+		run(sp->queue);
+		sp->queue.close();
+	    } catch (...) {
+		sp->queue.close(std::current_exception());
+	    }
+	});
+
+    std::function<bool(py_object &)> pf = [state](py_object &ret) -> bool
+	{
+	    Q x;
+	    if (!state->queue.pop(x))
+		return false;
+	    ret = converter<Q>::to_python(std::move(x));
+	    return true;
+	};
+
+    return make_python_generator(pf);
+}
+
+
+template<typename T, typename std::enable_if<converts_to_python<std::vector<T>>::value,int>::type = 0>
+inline py_object _start_chunked_producer(const threaded_generator<T> &g)
+{
+    std::function<bool(T &)> next = g.next;
+    ssize_t chunk_size = g.chunk_size;
+
+    std::function<void(prefetch_queue<std::vector<T>> &)> run = [next,chunk_size](prefetch_queue<std::vector<T>> &q)
+	{
+	    for (;;) {
+		std::vector<T> chunk;
+		chunk.reserve(chunk_size);
+
+		T x;
+		while (((ssize_t)chunk.size() < chunk_size) && next(x))
+		    chunk.push_back(std::move(x));
+
+		bool last = ((ssize_t)chunk.size() < chunk_size);
+
+		if (chunk.size() > 0)
+		    if (!q.push(std::move(chunk)))
+			return;  // cancelled
+		if (last)
+		    return;
+	    }
+	};
+
+    return _start_threaded_producer<std::vector<T>> (g.depth, run);
+}
+
+
+template<typename T, typename std::enable_if<!converts_to_python<std::vector<T>>::value,int>::type = 0>
+inline py_object _start_chunked_producer(const threaded_generator<T> &g)
+{
+    throw std::runtime_error("pyclops: threaded_generator with chunk_size > 0 requires a to_python converter for std::vector<T>");
+}
+
+
+template<typename T>
+struct converter<threaded_generator<T>> {
+    static py_object to_python(const threaded_generator<T> &g)
+    {
+	if (!g.next)
+	    throw std::runtime_error("pyclops: threaded_generator<T> to_python converter: empty callback");
+	if (g.depth <= 0)
+	    throw std::runtime_error("pyclops: threaded_generator<T> to_python converter: depth must be positive");
+	if (g.chunk_size < 0)
+	    throw std::runtime_error("pyclops: threaded_generator<T> to_python converter: chunk_size must be non-negative");
+
+	if (g.chunk_size > 0)
+	    return _start_chunked_producer(g);
+
+	std::function<bool(T &)> next = g.next;
+
+	std::function<void(prefetch_queue<T> &)> run = [next](prefetch_queue<T> &q)
+	    {
+		for (;;) {
+		    T x;
+		    if (!next(x) || !q.push(std::move(x)))
+			return;
+		}
+	    };
+
+	return _start_threaded_producer<T> (g.depth, run);
+    }
+};
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_THREADED_GENERATOR_HPP
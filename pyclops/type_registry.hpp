@@ -0,0 +1,100 @@
+#ifndef _PYCLOPS_TYPE_REGISTRY_HPP
+#define _PYCLOPS_TYPE_REGISTRY_HPP
+
+#include <string>
+#include <cstdint>
+#include <typeinfo>
+
+#include "core.hpp"
+#include "extension_type.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Sharing extension types between extension modules.
+//
+// Every extension_type which is added to an extension_module (with add_type()) is also registered in
+// a process-wide type registry, under the name "<module_name>.<type_name>".  A second module can look
+// up the extension_type by name, and use it for its own converters, so that objects pass between the
+// modules without conversion (and there is only one python type for each C++ type).
+//
+//   // In module 'geometry', as usual:
+//   static extension_type<Mesh> Mesh_type("Mesh", "A triangle mesh");
+//   namespace pyclops { template<> struct xconverter<Mesh> { static constexpr extension_type<Mesh> *type = &Mesh_type; }; }
+//   ...
+//   m.add_type(Mesh_type);   // registers "geometry.Mesh"
+//
+//   // In module 'render': the xconverter points to the extension_type in 'geometry'.
+//   namespace pyclops { template<> struct xconverter<Mesh> { static extension_type<Mesh> *type; }; }
+//   extension_type<Mesh> *pyclops::xconverter<Mesh>::type = nullptr;
+//   ...
+//   // In initrender(), before any conversions (imports 'geometry' if necessary):
+//   xconverter<Mesh>::type = import_extension_type<Mesh> ("geometry.Mesh");
+//
+// import_extension_type<T,B>() throws an exception if the name is not registered, or if it was registered
+// with a different C++ type T (or base type B).  C++ types are compared by their mangled typeid names, so
+// both modules must be compiled with ABI-compatible compilers (and the same pyclops headers).
+//
+// The registry is a PyCapsule stored in sys._pyclops_type_registry.  Note that other per-process state
+// (e.g. the table which maps C++ pointers to python objects, and the type_stats) lives in libpyclops.so,
+// so all modules which share extension types must be linked against the same libpyclops.so.  Otherwise,
+// objects which pass between the modules may be wrapped twice, or freed prematurely.
+
+
+static constexpr uint32_t type_registry_magic = 0x70797472;   // "pytr"
+static constexpr uint32_t type_registry_version = 1;
+
+
+struct type_registry_entry {
+    const char *name;         // "<module_name>.<type_name>"
+    const char *cpp_type;     // typeid(T).name()
+    const char *cpp_base;     // typeid(B).name()
+    void *type;               // extension_type<T,B> *
+    PyTypeObject *tobj;
+};
+
+
+// The function pointers are defined by whichever module created the registry.
+struct type_registry {
+    uint32_t magic;
+    uint32_t version;
+
+    // Returns NULL if not found.
+    const type_registry_entry *(*find)(const char *name);
+
+    // Copies the entry (including strings).  Caller must check that the name is not already registered.
+    void (*add)(const type_registry_entry *e);
+};
+
+
+template<typename T, typename B=T>
+inline extension_type<T,B> *import_extension_type(const std::string &name);
+
+
+// Called by extension_module::add_type().
+extern void _register_extension_type(const std::string &name, const std::type_info &t, const std::type_info &b, void *type, PyTypeObject *tobj);
+
+// Called by import_extension_type().  Throws an exception if not found, or if the C++ types don't match.
+extern void *_import_extension_type(const std::string &name, const std::type_info &t, const std::type_info &b);
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Implementation.
+
+
+template<typename T, typename B>
+inline extension_type<T,B> *import_extension_type(const std::string &name)
+{
+    return static_cast<extension_type<T,B> *> (_import_extension_type(name, typeid(T), typeid(B)));
+}
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_TYPE_REGISTRY_HPP
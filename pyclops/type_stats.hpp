@@ -0,0 +1,101 @@
+#ifndef _PYCLOPS_TYPE_STATS_HPP
+#define _PYCLOPS_TYPE_STATS_HPP
+
+#include <string>
+#include <cstdint>
+
+#include "core.hpp"
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Per-type live-object accounting for extension types, for tracking down memory growth.
+//
+// Every extension_type<T> counts the python objects it creates (in _make() and tp_init()) and
+// destroys (in tp_dealloc()), split into python-managed and C++-managed objects (see the comments
+// for class_wrapper<T> in pyclops/extension_type.hpp).  The counters are always on: they are plain
+// integers, updated with the GIL held.  To expose to python:
+//
+//   m.add_function("type_stats", "returns a snapshot of per-type object counts", wrap_func(get_type_stats));
+//   m.add_function("type_stats_diff", "compares two snapshots", wrap_func(diff_type_stats, "before", "after"));
+//
+//   # python
+//   s0 = m.type_stats()
+//   run_job()
+//   s1 = m.type_stats()
+//   print m.type_stats_diff(s0, s1)    # only types whose counts changed
+//
+// A snapshot is a dict { 'time': t, 'types': { name: counts } }.  The name is "<module_name>.<type_name>"
+// (the name used by the type registry, see pyclops/type_registry.hpp), or just the type name for an
+// extension type which was never added to a module.  Types with the same name are merged.  The 'counts'
+// are a dict with keys:
+//
+//   live_python, live_cpp    current number of python-managed and C++-managed objects
+//   live, peak_live          current and peak total
+//   nalloc, ndealloc         cumulative number of objects created and destroyed
+//   sizeof                   sizeof(T)
+//   nbytes                   live * sizeof(T), a lower bound on memory held by live objects
+//                            (doesn't include heap memory owned by T, or the PyObjects themselves)
+//
+// The diff has the same form, with 'elapsed' (seconds) in place of 'time'.  For each type, the
+// counts are differences (after - before), except 'peak_live' and 'sizeof' which are taken from
+// 'after'.  It also has 'alloc_rate' and 'dealloc_rate' (objects per second over the interval).
+//
+// Objects of a python subclass of an extension type are counted under the extension type.  Objects
+// of a wrapped C++ derived class (extension_type<Derived,Base>) are counted under the derived type.
+// The type_stats are kept on the extension_type (rather than in a per-T static), so that objects
+// created by other modules (see import_extension_type() in pyclops/type_registry.hpp) are counted.
+// Note that C++-managed objects are counted while their python object is alive, which may be shorter
+// than the C++ object's lifetime.
+
+
+struct type_stats {
+    PyTypeObject *const tobj;
+    std::string name;           // tobj->tp_name, qualified by the module name in extension_module::add_type()
+    const ssize_t itemsize;     // sizeof(T)
+
+    int64_t live_python = 0;
+    int64_t live_cpp = 0;
+    int64_t peak_live = 0;
+    int64_t nalloc = 0;
+    int64_t ndealloc = 0;
+
+    type_stats(PyTypeObject *tobj, ssize_t itemsize);
+
+    inline void add(bool cpp_managed)
+    {
+	(cpp_managed ? live_cpp : live_python)++;
+	nalloc++;
+
+	if (live_python + live_cpp > peak_live)
+	    peak_live = live_python + live_cpp;
+    }
+
+    inline void remove(bool cpp_managed)
+    {
+	(cpp_managed ? live_cpp : live_python)--;
+	ndealloc++;
+    }
+};
+
+
+// Creates and registers a new type_stats (never deleted).  Called by extension_type<T,B>::_construct().
+extern type_stats *make_type_stats(PyTypeObject *tobj, ssize_t itemsize);
+
+// Returns the type_stats for 'tobj', or its innermost base class with type_stats (NULL if none).
+// Called by extension_type<T,B>::tp_dealloc().
+extern type_stats *find_type_stats(PyTypeObject *tobj);
+
+// Can be wrapped with wrap_func() as shown above.
+extern py_dict get_type_stats();
+extern py_dict diff_type_stats(const py_dict &before, const py_dict &after);
+
+
+}  // namespace pyclops
+
+#endif  // _PYCLOPS_TYPE_STATS_HPP
@@ -3,6 +3,8 @@
 
 #include "core.hpp"
 #include "extension_type.hpp"
+#include "gil_stats.hpp"
+#include "probes.hpp"
 
 namespace pyclops {
 #if 0
@@ -43,6 +45,7 @@ struct virtual_function {
     py_object f_base;
     py_object f_self;
     bool exists;
+    const char *method_name;   // for the upcall probes (see pyclops/probes.hpp)
 
     template<typename T, typename B, typename TT>
     virtual_function(const extension_type<T,B> &type, const TT *self, const char *method_name);
@@ -55,7 +58,7 @@ struct virtual_function {
 template<typename R>
 struct pure_virtual_function : virtual_function<R> {
     // Inherits the following members from virtual_function<R> base class:
-    //    self, f_base, f_self, exists
+    //    self, f_base, f_self, exists, method_name
     //    upcall()
 
     template<typename T, typename B, typename TT>
@@ -71,6 +74,27 @@ struct pure_virtual_function : virtual_function<R> {
 // which is expensive!  What's the best way of doing it?
 
 
+// Fires the upcall_entry probe, and the upcall_return probe on scope exit, so that entry/return
+// probes stay balanced if the upcall throws (see pyclops/probes.hpp).
+struct _upcall_probes {
+    const char *method_name;
+
+    _upcall_probes(const char *method_name_, int nargs) :
+	method_name(method_name_)
+    {
+	PYCLOPS_PROBE2(upcall_entry, method_name, nargs);
+    }
+
+    ~_upcall_probes()
+    {
+	PYCLOPS_PROBE1(upcall_return, method_name);
+    }
+
+    _upcall_probes(const _upcall_probes &) = delete;
+    _upcall_probes &operator=(const _upcall_probes &) = delete;
+};
+
+
 // Helper for virtual_function constructor: converts C++ 'self' to python 'self'.
 template<typename T, typename B, typename TT>
 inline py_object _vf_self(const extension_type<T,B> &type, const TT *self)
@@ -123,11 +147,12 @@ inline py_object _vf_fself(const py_object &self, const char *method_name)
 
 template<typename R>
 template<typename T, typename B, typename TT>
-virtual_function<R>::virtual_function(const extension_type<T,B> &type, const TT *self_, const char *method_name) :
+virtual_function<R>::virtual_function(const extension_type<T,B> &type, const TT *self_, const char *method_name_) :
     self(_vf_self(type, self_)),
-    f_base(_vf_fbase(type, method_name)),
-    f_self(_vf_fself(self, method_name)),
-    exists(f_base.ptr != f_self.ptr)
+    f_base(_vf_fbase(type, method_name_)),
+    f_self(_vf_fself(self, method_name_)),
+    exists(f_base.ptr != f_self.ptr),
+    method_name(method_name_)
 { }
 
 
@@ -141,8 +166,17 @@ inline R virtual_function<R>::upcall(const Ts & ... args)
     // Since 'f_self' was obtained from the PyTypeObject (not the PyObject), 
     // it is "unbound" and we need to prepend 'self' to the argument list.
 
-    py_tuple t = py_tuple::make(self, args...);
-    py_object ret = f_self.call(t);
+    py_object ret;
+
+    {
+	_upcall_probes p(method_name, sizeof...(Ts));
+	_gil_upcall_timer g;   // see pyclops/gil_stats.hpp
+	g.held(self, method_name);
+
+	py_tuple t = py_tuple::make(self, args...);
+	ret = f_self.call(t);
+    }
+
     return converter<R>::from_python(ret);
 }
 
@@ -157,13 +191,15 @@ struct virtual_function<void> {
     py_object f_base;
     py_object f_self;
     bool exists;
+    const char *method_name;
 
     template<typename T, typename B, typename TT>
-    virtual_function(const extension_type<T,B> &type, const TT *self_, const char *method_name) :
+    virtual_function(const extension_type<T,B> &type, const TT *self_, const char *method_name_) :
 	self(_vf_self(type, self_)),
-	f_base(_vf_fbase(type, method_name)),
-	f_self(_vf_fself(self, method_name)),
-	exists(f_base.ptr != f_self.ptr)
+	f_base(_vf_fbase(type, method_name_)),
+	f_self(_vf_fself(self, method_name_)),
+	exists(f_base.ptr != f_self.ptr),
+	method_name(method_name_)
     { }
 
     template<typename... Ts>
@@ -171,6 +207,9 @@ struct virtual_function<void> {
     {
 	if (!exists)
 	    throw std::runtime_error("pure_virtual_function::upcall() applied when exists=false (this is a bug in the C++ wrapper code)");
+	_upcall_probes p(method_name, sizeof...(Ts));
+	_gil_upcall_timer g;
+	g.held(self, method_name);
 	py_tuple t = py_tuple::make(self, args...);
 	f_self.call(t);
     }
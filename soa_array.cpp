@@ -0,0 +1,209 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/soa_array.hpp"
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// _soa_base
+
+
+_soa_base::_soa_base(ssize_t nrecords_, const vector<record_field> &fields_) :
+    nrecords(nrecords_),
+    fields(&fields_)
+{
+    if (nrecords < 0)
+	throw runtime_error("pyclops: soa_array constructor was called with negative size");
+
+    for (const record_field &f: fields_) {
+	// Zero-initialized, like numpy.zeros().
+	char *p = (char *) calloc(max(nrecords,ssize_t(1)), f.itemsize);
+	if (!p)
+	    throw bad_alloc();
+	columns.push_back(p);
+    }
+}
+
+
+_soa_base::~_soa_base()
+{
+    for (char *p: columns)
+	free(p);
+    columns.clear();
+}
+
+
+int _soa_base::field_index(const char *name) const
+{
+    for (unsigned int j = 0; j < fields->size(); j++)
+	if ((*fields)[j].name == name)
+	    return j;
+    return -1;
+}
+
+
+// Helper for column_view(), element_view().
+static py_array soa_view(int ndim, npy_intp *shape, const record_field &f, char *data, const py_object &base)
+{
+    // PyArray_NewFromDescr() steals a reference to the dtype.
+    PyArray_Descr *desc = reinterpret_cast<PyArray_Descr *> (f.dtype.ptr);
+    Py_INCREF(desc);
+
+    PyObject *p = PyArray_NewFromDescr(&PyArray_Type, desc, ndim, shape, NULL, data, NPY_ARRAY_CARRAY, NULL);
+    py_array ret = py_array::new_reference(p);
+
+    int err = PyArray_SetBaseObject(ret.aptr(), base.ptr);
+    if (err < 0)
+	throw pyerr_occurred("pyclops::soa_array");
+
+    // PyArray_SetBaseObject() steals the 'base' reference, so we need to balance the books.
+    Py_INCREF(base.ptr);
+
+    return ret;
+}
+
+
+py_array _soa_base::column_view(int j, const py_object &base) const
+{
+    npy_intp n = nrecords;
+    return soa_view(1, &n, (*fields)[j], columns[j], base);
+}
+
+
+py_array _soa_base::element_view(int j, ssize_t i, const py_object &base) const
+{
+    const record_field &f = (*fields)[j];
+    return soa_view(0, NULL, f, columns[j] + i * f.itemsize, base);
+}
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// soa_proxy: the python object returned by soa_array.__getitem__().
+//
+// Holds a reference to the container, and an index.  Attribute access reads/writes
+// the corresponding element of each column (no per-record C++ or python state).
+
+
+struct soa_proxy_object {
+    PyObject_HEAD
+    PyObject *container;   // holds reference
+    _soa_base *soa;
+    ssize_t index;
+};
+
+
+static void soa_proxy_dealloc(PyObject *self)
+{
+    soa_proxy_object *sp = reinterpret_cast<soa_proxy_object *> (self);
+    Py_XDECREF(sp->container);
+    PyObject_Del(self);
+}
+
+
+static PyObject *soa_proxy_getattro(PyObject *self, PyObject *name)
+{
+    soa_proxy_object *sp = reinterpret_cast<soa_proxy_object *> (self);
+    const char *s = PyString_Check(name) ? PyString_AsString(name) : NULL;
+    int j = s ? sp->soa->field_index(s) : -1;
+
+    if (j < 0)
+	return PyObject_GenericGetAttr(self, name);
+
+    try {
+	// PyArray_Scalar() copies the element into a new numpy scalar.
+	const record_field &f = (*sp->soa->fields)[j];
+	char *data = sp->soa->columns[j] + sp->index * f.itemsize;
+	return PyArray_Scalar(data, reinterpret_cast<PyArray_Descr *> (f.dtype.ptr), NULL);
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return NULL;
+    }
+}
+
+
+static int soa_proxy_setattro(PyObject *self, PyObject *name, PyObject *value)
+{
+    soa_proxy_object *sp = reinterpret_cast<soa_proxy_object *> (self);
+    const char *s = PyString_Check(name) ? PyString_AsString(name) : NULL;
+    int j = s ? sp->soa->field_index(s) : -1;
+
+    if (j < 0)
+	return PyObject_GenericSetAttr(self, name, value);
+
+    if (!value) {
+	PyErr_SetString(PyExc_AttributeError, "pyclops: soa_array fields cannot be deleted");
+	return -1;
+    }
+
+    try {
+	py_object container = py_object::borrowed_reference(sp->container);
+	py_array dst = sp->soa->element_view(j, sp->index, container);
+	return PyArray_CopyObject(dst.aptr(), value);
+    }
+    catch (std::exception &e) {
+	set_python_error(e);
+	return -1;
+    }
+}
+
+
+static PyObject *soa_proxy_repr(PyObject *self)
+{
+    soa_proxy_object *sp = reinterpret_cast<soa_proxy_object *> (self);
+    return PyString_FromFormat("<%s[%zd]>", sp->container->ob_type->tp_name, sp->index);
+}
+
+
+static PyTypeObject *soa_proxy_type()
+{
+    static PyTypeObject *ret = nullptr;
+
+    if (ret)
+	return ret;
+
+    PyTypeObject *tobj = _make_static_type("pyclops.soa_proxy", "Proxy for one record of a pyclops soa_array (attributes read/write the underlying columns)", sizeof(soa_proxy_object));
+    tobj->tp_dealloc = soa_proxy_dealloc;
+    tobj->tp_getattro = soa_proxy_getattro;
+    tobj->tp_setattro = soa_proxy_setattro;
+    tobj->tp_repr = soa_proxy_repr;
+
+    if (PyType_Ready(tobj) < 0)
+	throw pyerr_occurred("pyclops::soa_proxy_type");
+
+    ret = tobj;
+    return ret;
+}
+
+
+py_object _soa_base::get_proxy(const py_object &self, ssize_t i)
+{
+    if (i < 0)
+	i += nrecords;
+    if ((i < 0) || (i >= nrecords)) {
+	PyErr_SetString(PyExc_IndexError, "soa_array index out of range");
+	throw pyerr_occurred();
+    }
+
+    PyTypeObject *tp = soa_proxy_type();
+    soa_proxy_object *sp = PyObject_New(soa_proxy_object, tp);
+    py_object ret = py_object::new_reference(reinterpret_cast<PyObject *> (sp));
+
+    Py_INCREF(self.ptr);
+    sp->container = self.ptr;
+    sp->soa = this;
+    sp->index = i;
+
+    return ret;
+}
+
+
+}  // namespace pyclops
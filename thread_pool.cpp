@@ -0,0 +1,92 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/thread_pool.hpp"
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+thread_pool::thread_pool(int nthreads)
+{
+    if (nthreads <= 0)
+	throw runtime_error("pyclops::thread_pool: number of threads must be positive");
+
+    for (int i = 0; i < nthreads; i++)
+	threads.push_back(std::thread(&thread_pool::worker_main, this));
+}
+
+
+thread_pool::~thread_pool()
+{
+    {
+	lock_guard<mutex> l(lock);
+	stopping = true;
+    }
+
+    cv.notify_all();
+
+    for (std::thread &t: threads)
+	t.join();
+}
+
+
+void thread_pool::submit(const std::function<void()> &task)
+{
+    if (!task)
+	throw runtime_error("pyclops::thread_pool::submit(): empty task");
+
+    {
+	lock_guard<mutex> l(lock);
+	if (stopping)
+	    throw runtime_error("pyclops::thread_pool::submit(): pool is being destroyed");
+	tasks.push_back(task);
+    }
+
+    cv.notify_one();
+}
+
+
+void thread_pool::worker_main()
+{
+    for (;;) {
+	std::function<void()> task;
+
+	{
+	    unique_lock<mutex> l(lock);
+	    cv.wait(l, [this] { return stopping || !tasks.empty(); });
+
+	    // Remaining tasks are run before exiting.
+	    if (tasks.empty())
+		return;
+
+	    task = std::move(tasks.front());
+	    tasks.pop_front();
+	}
+
+	task();
+    }
+}
+
+
+thread_pool &thread_pool::global()
+{
+    // FIXME memory leak (intentional, see comment in pyclops/thread_pool.hpp).
+    static thread_pool *pool = nullptr;
+    static std::once_flag once;
+
+    std::call_once(once, []()
+	{
+	    const char *s = getenv("PYCLOPS_NUM_THREADS");
+	    int n = s ? atoi(s) : (int) std::thread::hardware_concurrency();
+	    pool = new thread_pool(max(n, 1));
+	});
+
+    return *pool;
+}
+
+
+}  // namespace pyclops
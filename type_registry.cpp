@@ -0,0 +1,138 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/type_registry.hpp"
+#include <deque>
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// -------------------------------------------------------------------------------------------------
+//
+// Registry storage.  These are only used if this copy of libpyclops creates the registry (otherwise,
+// the function pointers in the existing capsule are used).
+
+
+// Note: deque rather than vector, since entries are returned by pointer.
+static deque<type_registry_entry> *registry_entries = nullptr;
+
+
+static const type_registry_entry *registry_find(const char *name)
+{
+    if (!registry_entries)
+	return nullptr;
+
+    for (const type_registry_entry &e: *registry_entries)
+	if (!strcmp(e.name, name))
+	    return &e;
+
+    return nullptr;
+}
+
+
+static void registry_add(const type_registry_entry *e)
+{
+    // FIXME memory leak (never freed, but only allocated once per type).
+    if (!registry_entries)
+	registry_entries = new deque<type_registry_entry> ();
+
+    type_registry_entry c = *e;
+    c.name = strdup(e->name);
+    c.cpp_type = strdup(e->cpp_type);
+    c.cpp_base = strdup(e->cpp_base);
+    registry_entries->push_back(c);
+}
+
+
+// Returns the process-wide registry, or NULL if it doesn't exist and 'create' is false.
+static type_registry *get_registry(bool create)
+{
+    static const char *capsule_name = "sys._pyclops_type_registry";
+
+    // Borrowed reference, no exception set if not found.
+    PyObject *capsule = PySys_GetObject((char *) "_pyclops_type_registry");
+
+    if (capsule) {
+	type_registry *r = reinterpret_cast<type_registry *> (PyCapsule_GetPointer(capsule, capsule_name));
+	if (!r)
+	    throw pyerr_occurred("pyclops::type_registry");
+	if ((r->magic != type_registry_magic) || (r->version != type_registry_version)) {
+	    throw runtime_error("pyclops: type registry was created by an incompatible version of pyclops (registry version "
+				+ to_string(r->version) + ", expected " + to_string(type_registry_version) + ")");
+	}
+	return r;
+    }
+
+    if (!create)
+	return nullptr;
+
+    // FIXME memory leak (never freed, but only allocated once per process).
+    type_registry *r = new type_registry;
+    r->magic = type_registry_magic;
+    r->version = type_registry_version;
+    r->find = registry_find;
+    r->add = registry_add;
+
+    py_object c = py_object::new_reference(PyCapsule_New(r, capsule_name, NULL));
+
+    if (PySys_SetObject((char *) "_pyclops_type_registry", c.ptr) < 0)
+	throw pyerr_occurred("pyclops::type_registry");
+
+    return r;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+void _register_extension_type(const string &name, const type_info &t, const type_info &b, void *type, PyTypeObject *tobj)
+{
+    type_registry *r = get_registry(true);
+    const type_registry_entry *e = r->find(name.c_str());
+
+    if (e) {
+	if (e->type == type)
+	    return;
+	throw runtime_error("pyclops: extension type '" + name + "' was registered twice (by different extension_type objects)");
+    }
+
+    type_registry_entry n;
+    n.name = name.c_str();
+    n.cpp_type = t.name();
+    n.cpp_base = b.name();
+    n.type = type;
+    n.tobj = tobj;
+
+    r->add(&n);
+}
+
+
+void *_import_extension_type(const string &name, const type_info &t, const type_info &b)
+{
+    // Import the module which defines the type (which registers the type when it initializes).
+    size_t dot = name.rfind('.');
+    if ((dot == string::npos) || (dot == 0))
+	throw runtime_error("pyclops::import_extension_type(): expected name of the form '<module_name>.<type_name>', got '" + name + "'");
+
+    string module_name = name.substr(0, dot);
+    py_object m = py_object::new_reference(PyImport_ImportModule(module_name.c_str()));
+
+    type_registry *r = get_registry(false);
+    const type_registry_entry *e = r ? r->find(name.c_str()) : nullptr;
+
+    if (!e)
+	throw runtime_error("pyclops::import_extension_type(): extension type '" + name + "' not found (note that types are registered by extension_module::add_type())");
+    if (strcmp(e->cpp_type, t.name()))
+	throw runtime_error("pyclops::import_extension_type(): extension type '" + name + "' wraps C++ type '" + e->cpp_type + "', caller expected '" + t.name() + "'");
+    if (strcmp(e->cpp_base, b.name()))
+	throw runtime_error("pyclops::import_extension_type(): extension type '" + name + "' has C++ base type '" + e->cpp_base + "', caller expected '" + b.name() + "'");
+
+    return e->type;
+}
+
+
+}  // namespace pyclops
@@ -0,0 +1,192 @@
+#define NO_IMPORT_ARRAY
+#include "pyclops/internals.hpp"
+#include "pyclops/type_stats.hpp"
+
+#include <map>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+
+using namespace std;
+
+namespace pyclops {
+#if 0
+}  // emacs pacifier
+#endif
+
+
+// FIXME memory leak (intentional, since extension_type objects are never destroyed either).
+static vector<type_stats *> *all_type_stats = nullptr;
+static unordered_map<PyTypeObject *, type_stats *> *type_stats_by_tobj = nullptr;
+
+
+type_stats::type_stats(PyTypeObject *tobj_, ssize_t itemsize_) :
+    tobj(tobj_), name(tobj_->tp_name), itemsize(itemsize_)
+{ }
+
+
+type_stats *make_type_stats(PyTypeObject *tobj, ssize_t itemsize)
+{
+    if (!all_type_stats) {
+	all_type_stats = new vector<type_stats *> ();
+	type_stats_by_tobj = new unordered_map<PyTypeObject *, type_stats *> ();
+    }
+
+    type_stats *ret = new type_stats(tobj, itemsize);
+    all_type_stats->push_back(ret);
+    (*type_stats_by_tobj)[tobj] = ret;
+    return ret;
+}
+
+
+type_stats *find_type_stats(PyTypeObject *tobj)
+{
+    if (!type_stats_by_tobj)
+	return nullptr;
+
+    // Walk up the base classes, in case 'tobj' is a python subclass of an extension type.
+    for ( ; tobj; tobj = tobj->tp_base) {
+	auto p = type_stats_by_tobj->find(tobj);
+	if (p != type_stats_by_tobj->end())
+	    return p->second;
+    }
+
+    return nullptr;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+static double _type_stats_time()
+{
+    auto t = chrono::system_clock::now().time_since_epoch();
+    return chrono::duration<double> (t).count();
+}
+
+
+// Like py_dict::get_item(), but with a sensible error message if the key is missing.
+static py_object _get_item(const py_dict &d, const char *key, const char *where)
+{
+    PyObject *ret = PyDict_GetItemString(d.ptr, key);   // borrowed reference
+    if (!ret)
+	throw runtime_error(string(where) + ": expected a snapshot returned by get_type_stats() (key '" + key + "' not found)");
+    return py_object::borrowed_reference(ret);
+}
+
+
+static int64_t _get_int(const py_dict &d, const char *key, const char *where)
+{
+    return converter<ssize_t>::from_python(_get_item(d, key, where), where);
+}
+
+
+// Counts for one name in get_type_stats() (see below).
+struct _type_counts {
+    int64_t live_python = 0;
+    int64_t live_cpp = 0;
+    int64_t peak_live = 0;
+    int64_t nalloc = 0;
+    int64_t ndealloc = 0;
+    int64_t nbytes = 0;
+    ssize_t itemsize = 0;
+};
+
+
+py_dict get_type_stats()
+{
+    // Types with the same name are merged (this can only happen for types which were never added
+    // to a module, since module-qualified names are unique).  The merged 'peak_live' is the sum of
+    // the peaks, and 'sizeof' is the largest sizeof(T).
+    map<string, _type_counts> counts;
+
+    if (all_type_stats) {
+	for (const type_stats *s: *all_type_stats) {
+	    _type_counts &c = counts[s->name];
+	    c.live_python += s->live_python;
+	    c.live_cpp += s->live_cpp;
+	    c.peak_live += s->peak_live;
+	    c.nalloc += s->nalloc;
+	    c.ndealloc += s->ndealloc;
+	    c.nbytes += (s->live_python + s->live_cpp) * s->itemsize;
+	    c.itemsize = max(c.itemsize, s->itemsize);
+	}
+    }
+
+    py_dict types;
+
+    for (const auto &p: counts) {
+	const _type_counts &c = p.second;
+
+	py_dict d;
+	d.set_item("live_python", converter<ssize_t>::to_python(c.live_python));
+	d.set_item("live_cpp", converter<ssize_t>::to_python(c.live_cpp));
+	d.set_item("live", converter<ssize_t>::to_python(c.live_python + c.live_cpp));
+	d.set_item("peak_live", converter<ssize_t>::to_python(c.peak_live));
+	d.set_item("nalloc", converter<ssize_t>::to_python(c.nalloc));
+	d.set_item("ndealloc", converter<ssize_t>::to_python(c.ndealloc));
+	d.set_item("sizeof", converter<ssize_t>::to_python(c.itemsize));
+	d.set_item("nbytes", converter<ssize_t>::to_python(c.nbytes));
+	types.set_item(p.first.c_str(), d);
+    }
+
+    py_dict ret;
+    ret.set_item("time", converter<double>::to_python(_type_stats_time()));
+    ret.set_item("types", types);
+    return ret;
+}
+
+
+py_dict diff_type_stats(const py_dict &before, const py_dict &after)
+{
+    static const char *where = "pyclops::diff_type_stats()";
+    static const char *diff_keys[] = { "live_python", "live_cpp", "live", "nalloc", "ndealloc", "nbytes" };
+
+    double elapsed = converter<double>::from_python(_get_item(after, "time", where), where) - converter<double>::from_python(_get_item(before, "time", where), where);
+    py_dict types0(_get_item(before, "types", where), where);
+    py_dict types1(_get_item(after, "types", where), where);
+    py_dict types;
+
+    PyObject *key;
+    PyObject *val;
+    Py_ssize_t pos = 0;
+
+    while (PyDict_Next(types1.ptr, &pos, &key, &val)) {
+	py_dict d1(py_object::borrowed_reference(val), where);
+
+	// Types which didn't exist in 'before' (e.g. a module was imported in between) start from zero.
+	PyObject *v0 = PyDict_GetItem(types0.ptr, key);   // borrowed reference
+	py_dict d0 = v0 ? py_dict(py_object::borrowed_reference(v0), where) : py_dict();
+
+	py_dict d;
+	bool changed = false;
+
+	for (const char *k: diff_keys) {
+	    int64_t x = _get_int(d1, k, where) - (v0 ? _get_int(d0, k, where) : 0);
+	    changed = changed || (x != 0);
+	    d.set_item(k, converter<ssize_t>::to_python(x));
+	}
+
+	if (!changed)
+	    continue;
+
+	double nalloc = _get_int(d1, "nalloc", where) - (v0 ? _get_int(d0, "nalloc", where) : 0);
+	double ndealloc = _get_int(d1, "ndealloc", where) - (v0 ? _get_int(d0, "ndealloc", where) : 0);
+
+	d.set_item("peak_live", _get_item(d1, "peak_live", where));
+	d.set_item("sizeof", _get_item(d1, "sizeof", where));
+	d.set_item("alloc_rate", converter<double>::to_python((elapsed > 0.0) ? (nalloc / elapsed) : 0.0));
+	d.set_item("dealloc_rate", converter<double>::to_python((elapsed > 0.0) ? (ndealloc / elapsed) : 0.0));
+
+	if (PyDict_SetItem(types.ptr, key, d.ptr) < 0)
+	    throw pyerr_occurred(where);
+    }
+
+    py_dict ret;
+    ret.set_item("elapsed", converter<double>::to_python(elapsed));
+    ret.set_item("types", types);
+    return ret;
+}
+
+
+}  // namespace pyclops